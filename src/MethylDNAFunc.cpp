@@ -3,10 +3,23 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+#include "fastaio.h"
+#include "nruns.h"
+#include "kmer.h"
+#include "revcomp.h"
 
 using namespace Rcpp;
 using namespace std;
 
+// [[Rcpp::init]]
+void DMMD_revcomp_init(DllInfo* dll) {
+    // Picks the complement kernels (revcomp.h) once, when the package is
+    // loaded, before any thread uses them.
+    revcomp_init();
+}
 
 // [[Rcpp::export]]
 List CooMov_cpp(List Config, List CooMetFor) {
@@ -42,84 +55,176 @@ List CooMov_cpp(List Config, List CooMetFor) {
     return CooMetForUpd;
 }
 
+// Helper: records of a fasta file as (offset, length) ranges of the file buffer.
+// Sequence lines are compacted in place and lowercased; no R API is used here,
+// so it can run on several files at the same time.
+struct FastaFile {
+    bool opened;
+    string error;   // why the file could not be opened or read in full
+    string data;
+    vector<pair<size_t, size_t> > records;
+    // n-run index of the first record, as c(starts, ends)
+    bool has_nruns;
+    vector<int> nruns;
+};
+
+static void read_fasta_file(const string& filename, int n_threads, FastaFile& out) {
+    out.opened = false;
+    out.has_nruns = false;
+    size_t n = 0;
+
+    if (fa_is_compressed(filename.c_str())) {
+        // gzip or BGZF: the uncompressed size is unknown, grow the buffer.
+        char err[256] = "";
+        FaStream* fs = fa_stream_open(filename.c_str(), n_threads, err, sizeof(err));
+        if (fs == NULL) {
+            out.error = err;
+            return;
+        }
+        out.opened = true;
+        out.data.resize(1 << 24);
+        long got;
+        while ((got = fa_stream_read(fs, &out.data[n], out.data.size() - n)) > 0) {
+            n += (size_t) got;
+            if (n == out.data.size()) out.data.resize(2 * n);
+        }
+        // A corrupted or truncated file would give a shortened chromosome.
+        if (got < 0) out.error = fa_stream_error(fs);
+        fa_stream_close(fs);
+        out.data.resize(n);
+        if (!out.error.empty()) return;
+    } else {
+        FILE* pF = fopen(filename.c_str(), "rb");
+        if (pF == NULL) return;
+        out.opened = true;
+
+        // Presize the buffer from the file size.
+        fseeko(pF, 0, SEEK_END);
+        off_t size = ftello(pF);
+        fseeko(pF, 0, SEEK_SET);
+        out.data.resize(size > 0 ? (size_t) size : 0);
+        n = out.data.empty() ? 0 : fread(&out.data[0], 1, out.data.size(), pF);
+        fclose(pF);
+        out.data.resize(n);
+    }
+
+    char* buf = n > 0 ? &out.data[0] : NULL;
+    size_t rd = 0, wr = 0, rec_start = 0;
+    while (rd < n) {
+        char* nl = (char*) memchr(buf + rd, '\n', n - rd);
+        size_t eol = nl ? (size_t) (nl - buf) : n;
+        size_t len = eol - rd;
+        if (len > 0 && buf[eol - 1] == '\r') len--;
+        if (len > 0 && buf[rd] == '>') {
+            if (wr > rec_start) out.records.push_back(make_pair(rec_start, wr - rec_start));
+            rec_start = wr;
+        } else {
+            memmove(buf + wr, buf + rd, len);
+            wr += len;
+        }
+        rd = eol + 1;
+    }
+    if (wr > rec_start) out.records.push_back(make_pair(rec_start, wr - rec_start));
+
+    // change to lowercase (branch free, so the compiler vectorizes it)
+    for (size_t i = 0; i < wr; i++) {
+        unsigned char c = (unsigned char) buf[i];
+        buf[i] = (char) (c | (((unsigned char) (c - 'A') < 26) << 5));
+    }
+
+    if (!out.records.empty()) {
+        NRunIndex idx;
+        if (nrun_build(buf + out.records[0].first, out.records[0].second, &idx) == 0) {
+            out.nruns.assign(idx.start, idx.start + idx.n);
+            out.nruns.insert(out.nruns.end(), idx.end, idx.end + idx.n);
+            nrun_free(&idx);
+            out.has_nruns = true;
+        }
+    }
+}
+
 // [[Rcpp::export]]
 List ReadFasta_cpp(List Config) {
-    // Reads chromosomes' fasta files and saves the sequences in an R structure
+    // Reads chromosomes' fasta files (plain, gzip or BGZF compressed) and saves
+    // the sequences in an R structure.
+    // The files are read and parsed in parallel (Config$nCPU threads).
     int NumAutosomes = as<int>(Config["NumAutosomes"]);
     CharacterVector Allosomes = Config["Allosomes"];
     string DirFas = as<string>(Config["DirFas"]);
+    int nCPU = Config.containsElementNamed("nCPU") ? as<int>(Config["nCPU"]) : omp_get_max_threads();
 
-    List SeqChr;
-
-    // Helper to read a fasta file and return all sequences as a CharacterVector
-    auto read_fasta = [](const string& filename) -> CharacterVector {
-        CharacterVector seqs;
-        ifstream file(filename);
-        if (!file.is_open()) {
-            Rcpp::Rcout << "Warning: could not open file " << filename << endl;
-            return seqs;
-        }
-        string line, seq;
-        while (getline(file, line)) {
-            if (!line.empty() && line[0] == '>') {
-                if (!seq.empty()) {
-                    seqs.push_back(seq);
-                    seq.clear();
-                }
-            } else {
-                // change to lowercase
-                transform(line.begin(), line.end(), line.begin(), ::tolower);
-                seq += line;
-            }
-        }
-        if (!seq.empty()) seqs.push_back(seq);
-        file.close();
-        return seqs;
-    };
-
-    // Read autosomes
+    vector<string> files;
+    // Autosomes
     for (int i1 = 0; i1 < NumAutosomes; i1++) {
-        string NamFilFas = "chr" + to_string(i1 + 1) + ".fa";
-        string FulNamFilFas = DirFas + "/" + NamFilFas;
-        CharacterVector seqs = read_fasta(FulNamFilFas);
-        SeqChr.push_back(seqs);
+        files.push_back(DirFas + "/chr" + to_string(i1 + 1) + ".fa");
     }
-
-    // Read allosomes
+    // Allosomes
     for (int i2 = 0; i2 < Allosomes.size(); i2++) {
-        string allosome = as<string>(Allosomes[i2]);
-        string NamFilFas = "chr" + allosome + ".fa";
-        string FulNamFilFas = DirFas + "/" + NamFilFas;
-        CharacterVector seqs = read_fasta(FulNamFilFas);
-        SeqChr.push_back(seqs);
+        files.push_back(DirFas + "/chr" + as<string>(Allosomes[i2]) + ".fa");
+    }
+    // chrN.fa.gz is read when chrN.fa does not exist
+    for (size_t i = 0; i < files.size(); i++) {
+        vector<char> resolved(files[i].size() + 4);
+        fa_path_resolve(files[i].c_str(), resolved.data(), resolved.size());
+        files[i] = resolved.data();
+    }
+
+    int nFiles = files.size();
+    vector<FastaFile> parsed(nFiles);
+    // Threads left over by the files inflate the blocks of BGZF files.
+    int nInflate = nFiles > 0 ? max(1, nCPU / nFiles) : 1;
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(max(1, nCPU))
+    for (int i = 0; i < nFiles; i++) {
+        read_fasta_file(files[i], nInflate, parsed[i]);
+    }
+
+    // R objects are built serially.
+    List SeqChr(nFiles);
+    for (int i = 0; i < nFiles; i++) {
+        if (!parsed[i].opened) {
+            Rcpp::Rcout << "Warning: could not open file " << files[i];
+            if (!parsed[i].error.empty()) Rcpp::Rcout << " (" << parsed[i].error << ")";
+            Rcpp::Rcout << endl;
+        } else if (!parsed[i].error.empty()) {
+            stop("ReadFasta_cpp: could not read %s: %s", files[i].c_str(), parsed[i].error.c_str());
+        }
+        CharacterVector seqs(parsed[i].records.size());
+        for (size_t j = 0; j < parsed[i].records.size(); j++) {
+            seqs[j] = Rf_mkCharLen(parsed[i].data.data() + parsed[i].records[j].first,
+                                   (int) parsed[i].records[j].second);
+        }
+        if (seqs.size() > 0 && parsed[i].has_nruns) {
+            // Lets SeqDic reject windows with gaps without scanning them.
+            seqs.attr("NRuns") = IntegerVector(parsed[i].nruns.begin(), parsed[i].nruns.end());
+        }
+        SeqChr[i] = seqs;
+        // Release the buffer as soon as it has been copied.
+        string().swap(parsed[i].data);
     }
 
     return SeqChr;
 }
 
-// Helper: compute reverse complement of a DNA sequence
-// Processes only the first 'len' characters
-string reverse_complement(const string& seq, int len) {
-    int actual_len = min(len, (int)seq.length());
-    string result(actual_len, ' ');
-    for (int i = 0; i < actual_len; ++i) {
-        char c = seq[i];
-        char complement;
-        switch(c) {
-            case 'a': complement = 't'; break;
-            case 'c': complement = 'g'; break;
-            case 'g': complement = 'c'; break;
-            case 't': complement = 'a'; break;
-            case 'A': complement = 'T'; break;
-            case 'C': complement = 'G'; break;
-            case 'G': complement = 'C'; break;
-            case 'T': complement = 'A'; break;
-            default: complement = c; break;  // preserve other characters (like 'n')
-        }
-        result[i] = complement;
+// Helper: reverse complements of the first len bases of each word (fewer
+// if a word is shorter), as R's Reverse does.
+static CharacterVector reverse_words(CharacterVector seqs, int len) {
+    int n = seqs.size();
+    CharacterVector revSeqs(n);
+    vector<char> buf(len + 1);
+    for (int i = 0; i < n; ++i) {
+        SEXP s = seqs[i];
+        int l = min(len, (int) LENGTH(s));
+        revcomp_ascii(CHAR(s), buf.data(), l);
+        revSeqs[i] = Rf_mkCharLen(buf.data(), l);
     }
-    // Reverse the string
-    std::reverse(result.begin(), result.end());
+    return revSeqs;
+}
+
+// Helper: a new list with the elements (not copies) of x, and its names.
+static List shallow_copy(List x) {
+    List result(x.size());
+    for (int i = 0; i < x.size(); ++i) result[i] = x[i];
+    if (!Rf_isNull(x.names())) result.names() = x.names();
     return result;
 }
 
@@ -129,7 +234,8 @@ List Rev_cpp(List Config, List SeqMetFreW) {
     int w_min = as<int>(Config["w_min"]);
     int w_max = as<int>(Config["w_max"]);
 
-    List result = clone(SeqMetFreW);
+    // The data frames that are not reversed are shared with the input.
+    List result = shallow_copy(SeqMetFreW);
 
     for (int w = w_min; w <= w_max; ++w) {
         if (result.size() < w || Rf_isNull(result[w - 1])) continue;
@@ -137,16 +243,8 @@ List Rev_cpp(List Config, List SeqMetFreW) {
         DataFrame df = as<DataFrame>(result[w - 1]);
         if (!df.containsElementNamed("Seq")) continue;
 
-        CharacterVector seqs = df["Seq"];
-        CharacterVector revSeqs(seqs.size());
-
         // Compute Len = 2*w + 2 to match R's Reverse function
-        int len = 2 * w + 2;
-
-        for (int i = 0; i < seqs.size(); ++i) {
-            string seq_str = as<string>(seqs[i]);
-            revSeqs[i] = reverse_complement(seq_str, len);
-        }
+        CharacterVector revSeqs = reverse_words(df["Seq"], 2 * w + 2);
 
         // Build new data.frame with reversed sequences
         DataFrame new_df = DataFrame::create(
@@ -168,26 +266,95 @@ List RevTot_cpp(List Config, List Seqs) {
     int w_min = as<int>(Config["w_min"]);
     int w_max = as<int>(Config["w_max"]);
 
-    List result = clone(Seqs);
+    List result = shallow_copy(Seqs);
 
     for (int w = w_min; w <= w_max; ++w) {
         if (result.size() < w || Rf_isNull(result[w - 1])) continue;
 
-        CharacterVector seqs = as<CharacterVector>(result[w - 1]);
-        CharacterVector revSeqs(seqs.size());
-
         // Compute Len = 2*w + 2 to match R's Reverse function
-        int len = 2 * w + 2;
+        result[w - 1] = reverse_words(as<CharacterVector>(result[w - 1]), 2 * w + 2);
+    }
+
+    return result;
+}
+
+// Helper: packed word of row i of a matrix of packed words (see kmer.h).
+static inline PackedKmer kmer_row(const NumericMatrix& Kmer, int i) {
+    PackedKmer k;
+    for (int j = 0; j < 3; ++j) {
+        double d = Kmer(i, j);
+        memcpy(&k.w[j], &d, sizeof(uint64_t));
+    }
+    return k;
+}
+
+static inline void kmer_set_row(NumericMatrix& Kmer, int i, const PackedKmer& k) {
+    for (int j = 0; j < 3; ++j) {
+        double d;
+        memcpy(&d, &k.w[j], sizeof(uint64_t));
+        Kmer(i, j) = d;
+    }
+}
+
+// Helper: word length of a matrix of packed words.
+static int kmer_len(const NumericMatrix& Kmer) {
+    RObject len = Kmer.attr("KmerLen");
+    if (Kmer.ncol() != 3 || len.isNULL()) {
+        stop("not a matrix of packed words");
+    }
+    return as<int>(len);
+}
 
-        for (int i = 0; i < seqs.size(); ++i) {
-            string seq_str = as<string>(seqs[i]);
-            revSeqs[i] = reverse_complement(seq_str, len);
+// [[Rcpp::export]]
+NumericMatrix PackWords_cpp(CharacterVector Seq, int Len) {
+    // Packs words of Len bases (see kmer.h). Words must only have a, c, g
+    // or t bases, so gaps must have been removed (DelGaps).
+    if (Len < 0 || Len > KMER_MAX_LEN) {
+        stop("PackWords_cpp: words longer than %d bases can not be packed", KMER_MAX_LEN);
+    }
+    int n = Seq.size();
+    NumericMatrix Kmer(n, 3);
+    for (int i = 0; i < n; ++i) {
+        PackedKmer k;
+        SEXP s = Seq[i];
+        if (s == NA_STRING || LENGTH(s) != Len || kmer_pack(CHAR(s), Len, &k) != 0) {
+            stop("PackWords_cpp: word %d is not %d a, c, g or t bases", i + 1, Len);
         }
+        kmer_set_row(Kmer, i, k);
+    }
+    Kmer.attr("KmerLen") = Len;
+    return Kmer;
+}
 
-        result[w - 1] = revSeqs;
+// [[Rcpp::export]]
+CharacterVector UnpackWords_cpp(NumericMatrix Kmer) {
+    // Words of a matrix of packed words, as lowercase strings.
+    int len = kmer_len(Kmer);
+    int n = Kmer.nrow();
+    CharacterVector Seq(n);
+    vector<char> buf(len + 1);
+    for (int i = 0; i < n; ++i) {
+        PackedKmer k = kmer_row(Kmer, i);
+        kmer_unpack(&k, len, buf.data());
+        Seq[i] = Rf_mkCharLen(buf.data(), len);
     }
+    return Seq;
+}
 
-    return result;
+// [[Rcpp::export]]
+NumericMatrix RevPackedWords_cpp(NumericMatrix Kmer) {
+    // Reverse complement of a matrix of packed words, as Rev_cpp does with
+    // strings.
+    int len = kmer_len(Kmer);
+    int n = Kmer.nrow();
+    NumericMatrix Out(n, 3);
+    for (int i = 0; i < n; ++i) {
+        PackedKmer k = kmer_row(Kmer, i), r;
+        kmer_revcomp(&k, len, &r);
+        kmer_set_row(Out, i, r);
+    }
+    Out.attr("KmerLen") = len;
+    return Out;
 }
 
 // [[Rcpp::export]]
@@ -410,4 +577,118 @@ List ResisMet_cpp(List Config, List SeqMetFreW) {
         SeqMetFreResis[idx] = new_df; // Store at index w (output)
     }
     return SeqMetFreResis;
-}
\ No newline at end of file
+}
+// Helper: data.frame(Seq, Methyl, Freq, Index) with the n rows whose class
+// has the bit cls_bit.
+static DataFrame partition_rows(const CharacterVector& Seq, const NumericVector& Methyl,
+                                const IntegerVector& Freq, const IntegerVector& Index,
+                                const vector<unsigned char>& cls, unsigned char cls_bit, int n) {
+    CharacterVector SeqNew(n);
+    NumericVector MethylNew(n);
+    IntegerVector FreqNew(n);
+    IntegerVector IndexNew(n);
+    int j = 0;
+    for (size_t i = 0; i < cls.size() && j < n; ++i) {
+        if (!(cls[i] & cls_bit)) continue;
+        SET_STRING_ELT(SeqNew, j, STRING_ELT(Seq, i));
+        MethylNew[j] = Methyl[i];
+        FreqNew[j] = Freq[i];
+        IndexNew[j] = Index[i];
+        ++j;
+    }
+    return DataFrame::create(
+        Named("Seq") = SeqNew,
+        Named("Methyl") = MethylNew,
+        Named("Freq") = FreqNew,
+        Named("Index") = IndexNew
+    );
+}
+
+// [[Rcpp::export]]
+List PartitionMet_cpp(List Config, List SeqMetFreW, bool Neutral = false, bool Gaps = true) {
+    // DelGaps_cpp, ProneMet_cpp and ResisMet_cpp in one pass over each
+    // width: if Gaps, drops the words with gaps ("n", either case), and
+    // splits the others into prone (Methyl >= Config$MethProne) and resistant
+    // (Methyl <= Config$MethResis) words, and if Neutral the words in
+    // between. The input is not copied: each row is classified once, and
+    // each output column is allocated at its final size.
+    // Returns list(Prone, Resis), plus Neutral, shaped as ProneMet_cpp's.
+    double MethProne = as<double>(Config["MethProne"]);
+    double MethResis = as<double>(Config["MethResis"]);
+    int w_min = as<int>(Config["w_min"]);
+    int w_max = as<int>(Config["w_max"]);
+    List Prone(w_max), Resis(w_max), Rest(w_max);
+
+    enum { PRONE = 1, RESIS = 2, NEUTRAL = 4 };
+    vector<unsigned char> cls;
+    for (int w = w_min; w <= w_max; ++w) {
+        int idx = w - 1;
+        if (idx < 0 || idx >= SeqMetFreW.size() || Rf_isNull(SeqMetFreW[idx])) continue;
+        DataFrame df = as<DataFrame>(SeqMetFreW[idx]);
+        if (!df.containsElementNamed("Methyl")) continue;
+
+        CharacterVector Seq = df["Seq"];
+        NumericVector Methyl = df["Methyl"];
+        IntegerVector Freq = df["Freq"];
+        IntegerVector Index = df["Index"];
+        int n = Seq.size();
+
+        int nProne = 0, nResis = 0, nNeutral = 0;
+        cls.assign(n, 0);
+        for (int i = 0; i < n; ++i) {
+            SEXP s = STRING_ELT(Seq, i);
+            if (Gaps && s != NA_STRING) {
+                const char* p = CHAR(s);
+                int len = LENGTH(s);
+                if (memchr(p, 'n', len) || memchr(p, 'N', len)) continue;
+            }
+            double m = Methyl[i];
+            unsigned char c = (m >= MethProne ? PRONE : 0) | (m <= MethResis ? RESIS : 0);
+            if (c == 0 && Neutral) c = NEUTRAL;
+            cls[i] = c;
+            nProne += (c & PRONE) != 0;
+            nResis += (c & RESIS) != 0;
+            nNeutral += (c & NEUTRAL) != 0;
+        }
+
+        Prone[idx] = partition_rows(Seq, Methyl, Freq, Index, cls, PRONE, nProne);
+        Resis[idx] = partition_rows(Seq, Methyl, Freq, Index, cls, RESIS, nResis);
+        if (Neutral) Rest[idx] = partition_rows(Seq, Methyl, Freq, Index, cls, NEUTRAL, nNeutral);
+    }
+
+    if (Neutral) {
+        return List::create(Named("Prone") = Prone, Named("Resis") = Resis, Named("Neutral") = Rest);
+    }
+    return List::create(Named("Prone") = Prone, Named("Resis") = Resis);
+}
+
+// [[Rcpp::export]]
+IntegerVector TopK_cpp(NumericVector Freq, int K) {
+    // Rows (1-based, in increasing order) of the K highest values of Freq,
+    // in one pass with nth_element instead of a sort. Ties keep the later
+    // rows, and NA counts as the highest value, as when the rows of
+    // head(sort.list(Freq), n = length(Freq) - K) are removed.
+    int n = Freq.size();
+    if (K >= n) {
+        IntegerVector All(n);
+        for (int i = 0; i < n; ++i) All[i] = i + 1;
+        return All;
+    }
+    if (K <= 0) return IntegerVector(0);
+
+    vector<int> rows(n);
+    for (int i = 0; i < n; ++i) rows[i] = i;
+    const double* f = Freq.begin();
+    auto higher = [f](int a, int b) {
+        bool na = ISNAN(f[a]), nb = ISNAN(f[b]);
+        if (na != nb) return na;
+        if (!na && f[a] != f[b]) return f[a] > f[b];
+        return a > b;
+    };
+    nth_element(rows.begin(), rows.begin() + (K - 1), rows.end(), higher);
+    sort(rows.begin(), rows.begin() + K);
+
+    IntegerVector Top(K);
+    for (int i = 0; i < K; ++i) Top[i] = rows[i] + 1;
+    return Top;
+}
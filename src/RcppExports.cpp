@@ -121,6 +121,228 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// find_strings_hash
+List find_strings_hash(StringVector in_str, StringVector out_str, int num_cpu);
+RcppExport SEXP _DMMD_find_strings_hash(SEXP in_strSEXP, SEXP out_strSEXP, SEXP num_cpuSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< StringVector >::type in_str(in_strSEXP);
+    Rcpp::traits::input_parameter< StringVector >::type out_str(out_strSEXP);
+    Rcpp::traits::input_parameter< int >::type num_cpu(num_cpuSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_strings_hash(in_str, out_str, num_cpu));
+    return rcpp_result_gen;
+END_RCPP
+}
+// Fusion_cpp
+List Fusion_cpp(List Config, List SeqMetFreW, List FreVecW);
+RcppExport SEXP _DMMD_Fusion_cpp(SEXP ConfigSEXP, SEXP SeqMetFreWSEXP, SEXP FreVecWSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< List >::type SeqMetFreW(SeqMetFreWSEXP);
+    Rcpp::traits::input_parameter< List >::type FreVecW(FreVecWSEXP);
+    rcpp_result_gen = Rcpp::wrap(Fusion_cpp(Config, SeqMetFreW, FreVecW));
+    return rcpp_result_gen;
+END_RCPP
+}
+// FusionModes_cpp
+List FusionModes_cpp(List Config, List SeqMetFreW, List FreVecW, CharacterVector Modes);
+RcppExport SEXP _DMMD_FusionModes_cpp(SEXP ConfigSEXP, SEXP SeqMetFreWSEXP, SEXP FreVecWSEXP, SEXP ModesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< List >::type SeqMetFreW(SeqMetFreWSEXP);
+    Rcpp::traits::input_parameter< List >::type FreVecW(FreVecWSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type Modes(ModesSEXP);
+    rcpp_result_gen = Rcpp::wrap(FusionModes_cpp(Config, SeqMetFreW, FreVecW, Modes));
+    return rcpp_result_gen;
+END_RCPP
+}
+// PackGenome_cpp
+void PackGenome_cpp(List Config, std::string PathOut);
+RcppExport SEXP _DMMD_PackGenome_cpp(SEXP ConfigSEXP, SEXP PathOutSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< std::string >::type PathOut(PathOutSEXP);
+    PackGenome_cpp(Config, PathOut);
+    return R_NilValue;
+END_RCPP
+}
+// OpenGenome_cpp
+List OpenGenome_cpp(std::string Path);
+RcppExport SEXP _DMMD_OpenGenome_cpp(SEXP PathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type Path(PathSEXP);
+    rcpp_result_gen = Rcpp::wrap(OpenGenome_cpp(Path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// OpenFastaIndex_cpp
+List OpenFastaIndex_cpp(List Config);
+RcppExport SEXP _DMMD_OpenFastaIndex_cpp(SEXP ConfigSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    rcpp_result_gen = Rcpp::wrap(OpenFastaIndex_cpp(Config));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadBedMethyl_cpp
+List ReadBedMethyl_cpp(List Config, std::string Path);
+RcppExport SEXP _DMMD_ReadBedMethyl_cpp(SEXP ConfigSEXP, SEXP PathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< std::string >::type Path(PathSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadBedMethyl_cpp(Config, Path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// MergeBedMethyl_cpp
+List MergeBedMethyl_cpp(List Config, CharacterVector Paths, bool Weighted, int MinDepth);
+RcppExport SEXP _DMMD_MergeBedMethyl_cpp(SEXP ConfigSEXP, SEXP PathsSEXP, SEXP WeightedSEXP, SEXP MinDepthSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type Paths(PathsSEXP);
+    Rcpp::traits::input_parameter< bool >::type Weighted(WeightedSEXP);
+    Rcpp::traits::input_parameter< int >::type MinDepth(MinDepthSEXP);
+    rcpp_result_gen = Rcpp::wrap(MergeBedMethyl_cpp(Config, Paths, Weighted, MinDepth));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadPB3Seq_cpp
+List ReadPB3Seq_cpp(List Config, std::string Dir);
+RcppExport SEXP _DMMD_ReadPB3Seq_cpp(SEXP ConfigSEXP, SEXP DirSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< std::string >::type Dir(DirSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadPB3Seq_cpp(Config, Dir));
+    return rcpp_result_gen;
+END_RCPP
+}
+// WriteSignalCache_cpp
+void WriteSignalCache_cpp(List CooMet, std::string Path, int Bits);
+RcppExport SEXP _DMMD_WriteSignalCache_cpp(SEXP CooMetSEXP, SEXP PathSEXP, SEXP BitsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type CooMet(CooMetSEXP);
+    Rcpp::traits::input_parameter< std::string >::type Path(PathSEXP);
+    Rcpp::traits::input_parameter< int >::type Bits(BitsSEXP);
+    WriteSignalCache_cpp(CooMet, Path, Bits);
+    return R_NilValue;
+END_RCPP
+}
+// ReadSignalCache_cpp
+List ReadSignalCache_cpp(std::string Path);
+RcppExport SEXP _DMMD_ReadSignalCache_cpp(SEXP PathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type Path(PathSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadSignalCache_cpp(Path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// PackWords_cpp
+NumericMatrix PackWords_cpp(CharacterVector Seq, int Len);
+RcppExport SEXP _DMMD_PackWords_cpp(SEXP SeqSEXP, SEXP LenSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type Seq(SeqSEXP);
+    Rcpp::traits::input_parameter< int >::type Len(LenSEXP);
+    rcpp_result_gen = Rcpp::wrap(PackWords_cpp(Seq, Len));
+    return rcpp_result_gen;
+END_RCPP
+}
+// UnpackWords_cpp
+CharacterVector UnpackWords_cpp(NumericMatrix Kmer);
+RcppExport SEXP _DMMD_UnpackWords_cpp(SEXP KmerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type Kmer(KmerSEXP);
+    rcpp_result_gen = Rcpp::wrap(UnpackWords_cpp(Kmer));
+    return rcpp_result_gen;
+END_RCPP
+}
+// RevPackedWords_cpp
+NumericMatrix RevPackedWords_cpp(NumericMatrix Kmer);
+RcppExport SEXP _DMMD_RevPackedWords_cpp(SEXP KmerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type Kmer(KmerSEXP);
+    rcpp_result_gen = Rcpp::wrap(RevPackedWords_cpp(Kmer));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DicWord_cpp
+List DicWord_cpp(List Config, List CooMet, List SeqChr, std::string Sense);
+RcppExport SEXP _DMMD_DicWord_cpp(SEXP ConfigSEXP, SEXP CooMetSEXP, SEXP SeqChrSEXP, SEXP SenseSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< List >::type CooMet(CooMetSEXP);
+    Rcpp::traits::input_parameter< List >::type SeqChr(SeqChrSEXP);
+    Rcpp::traits::input_parameter< std::string >::type Sense(SenseSEXP);
+    rcpp_result_gen = Rcpp::wrap(DicWord_cpp(Config, CooMet, SeqChr, Sense));
+    return rcpp_result_gen;
+END_RCPP
+}
+// DicWordCanonical_cpp
+List DicWordCanonical_cpp(List Config, List CooMetFor, List CooMetRev, List SeqChr);
+RcppExport SEXP _DMMD_DicWordCanonical_cpp(SEXP ConfigSEXP, SEXP CooMetForSEXP, SEXP CooMetRevSEXP, SEXP SeqChrSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< List >::type CooMetFor(CooMetForSEXP);
+    Rcpp::traits::input_parameter< List >::type CooMetRev(CooMetRevSEXP);
+    Rcpp::traits::input_parameter< List >::type SeqChr(SeqChrSEXP);
+    rcpp_result_gen = Rcpp::wrap(DicWordCanonical_cpp(Config, CooMetFor, CooMetRev, SeqChr));
+    return rcpp_result_gen;
+END_RCPP
+}
+// PartitionMet_cpp
+List PartitionMet_cpp(List Config, List SeqMetFreW, bool Neutral, bool Gaps);
+RcppExport SEXP _DMMD_PartitionMet_cpp(SEXP ConfigSEXP, SEXP SeqMetFreWSEXP, SEXP NeutralSEXP, SEXP GapsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type Config(ConfigSEXP);
+    Rcpp::traits::input_parameter< List >::type SeqMetFreW(SeqMetFreWSEXP);
+    Rcpp::traits::input_parameter< bool >::type Neutral(NeutralSEXP);
+    Rcpp::traits::input_parameter< bool >::type Gaps(GapsSEXP);
+    rcpp_result_gen = Rcpp::wrap(PartitionMet_cpp(Config, SeqMetFreW, Neutral, Gaps));
+    return rcpp_result_gen;
+END_RCPP
+}
+// TopK_cpp
+IntegerVector TopK_cpp(NumericVector Freq, int K);
+RcppExport SEXP _DMMD_TopK_cpp(SEXP FreqSEXP, SEXP KSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type Freq(FreqSEXP);
+    Rcpp::traits::input_parameter< int >::type K(KSEXP);
+    rcpp_result_gen = Rcpp::wrap(TopK_cpp(Freq, K));
+    return rcpp_result_gen;
+END_RCPP
+}
 // c_bound_test_openmp
 NumericVector c_bound_test_openmp(NumericVector vin, int ncores);
 RcppExport SEXP _DMMD_c_bound_test_openmp(SEXP vinSEXP, SEXP ncoresSEXP) {
@@ -176,6 +398,24 @@ static const R_CallMethodDef CallEntries[] = {
     {"_DMMD_fuse_seqs_openmp", (DL_FUNC) &_DMMD_fuse_seqs_openmp, 12},
     {"_DMMD_find_strings_seq", (DL_FUNC) &_DMMD_find_strings_seq, 2},
     {"_DMMD_find_strings_par", (DL_FUNC) &_DMMD_find_strings_par, 3},
+    {"_DMMD_find_strings_hash", (DL_FUNC) &_DMMD_find_strings_hash, 3},
+    {"_DMMD_Fusion_cpp", (DL_FUNC) &_DMMD_Fusion_cpp, 3},
+    {"_DMMD_FusionModes_cpp", (DL_FUNC) &_DMMD_FusionModes_cpp, 4},
+    {"_DMMD_PackGenome_cpp", (DL_FUNC) &_DMMD_PackGenome_cpp, 2},
+    {"_DMMD_OpenGenome_cpp", (DL_FUNC) &_DMMD_OpenGenome_cpp, 1},
+    {"_DMMD_OpenFastaIndex_cpp", (DL_FUNC) &_DMMD_OpenFastaIndex_cpp, 1},
+    {"_DMMD_ReadBedMethyl_cpp", (DL_FUNC) &_DMMD_ReadBedMethyl_cpp, 2},
+    {"_DMMD_MergeBedMethyl_cpp", (DL_FUNC) &_DMMD_MergeBedMethyl_cpp, 4},
+    {"_DMMD_ReadPB3Seq_cpp", (DL_FUNC) &_DMMD_ReadPB3Seq_cpp, 2},
+    {"_DMMD_WriteSignalCache_cpp", (DL_FUNC) &_DMMD_WriteSignalCache_cpp, 3},
+    {"_DMMD_ReadSignalCache_cpp", (DL_FUNC) &_DMMD_ReadSignalCache_cpp, 1},
+    {"_DMMD_PackWords_cpp", (DL_FUNC) &_DMMD_PackWords_cpp, 2},
+    {"_DMMD_UnpackWords_cpp", (DL_FUNC) &_DMMD_UnpackWords_cpp, 1},
+    {"_DMMD_RevPackedWords_cpp", (DL_FUNC) &_DMMD_RevPackedWords_cpp, 1},
+    {"_DMMD_DicWord_cpp", (DL_FUNC) &_DMMD_DicWord_cpp, 4},
+    {"_DMMD_DicWordCanonical_cpp", (DL_FUNC) &_DMMD_DicWordCanonical_cpp, 4},
+    {"_DMMD_PartitionMet_cpp", (DL_FUNC) &_DMMD_PartitionMet_cpp, 4},
+    {"_DMMD_TopK_cpp", (DL_FUNC) &_DMMD_TopK_cpp, 2},
     {"_DMMD_c_bound_test_openmp", (DL_FUNC) &_DMMD_c_bound_test_openmp, 2},
     {"_DMMD_c_bound_test_seq", (DL_FUNC) &_DMMD_c_bound_test_seq, 1},
     {"_DMMD_scan_seqs_c", (DL_FUNC) &_DMMD_scan_seqs_c, 5},
@@ -189,7 +429,9 @@ static const R_CallMethodDef CallEntries[] = {
     {NULL, NULL, 0}
 };
 
+void DMMD_revcomp_init(DllInfo* dll);
 RcppExport void R_init_DMMD(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    DMMD_revcomp_init(dll);
 }
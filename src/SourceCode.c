@@ -4,30 +4,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <omp.h> 
-
-char * reverse_seq(char* seq, int seq_len){
-  int i;
-  char rev_seq[seq_len+1];
-  for (i=0; i < seq_len; i++){
-    if (tolower(seq[i])=='c') rev_seq[i] = 'g';
-    else if (tolower(seq[i])=='g') rev_seq[i] = 'c';
-    else if (tolower(seq[i])=='t') rev_seq[i] = 'a';
-    else if (tolower(seq[i])=='a') rev_seq[i] = 't';
-  }
-  rev_seq[seq_len]='\0';
-  return(strdup(rev_seq));
-}
-
-short contains_wrong_chars(char * seq, int seq_len){
-    char c_char;
-    int i;
-    for (i=0; i < seq_len; i++){
-        c_char = tolower(seq[i]);
-        if (c_char!='c' && c_char!='g' && c_char!='t' && c_char!='a')
-            return(1);
-    }
-    return(0);
-}
+#include "seqsrc.h"
+#include "revcomp.h"
 
 /* 
  * General comments:
@@ -46,46 +24,52 @@ SEXP SeqDic(SEXP CooMet, SEXP LenDic, SEXP nrow, SEXP SeqChr, SEXP LenChr, SEXP
    * CooMet: Vector with coordinates and methylation frequencys of the target sites.
    * LenDic: Length of the words to be extracted.
    * nrow: Length of the coordinates' vector.
-   * SeqChr: Sequence of the current chromosome.
+   * SeqChr: Sequence of the current chromosome, or list(<packed genome>, <contig number>)
+   *  or list(<fasta index>, <record number>) to read the windows from a packed genome
+   *  or an indexed fasta file (LenChr is then taken from the genome).
    * TargetGrowMode: Growing mode of the words around the start coordinate.
    *  "C" (central), "R" (Lateral right) or "L" (Lateral left).
    * X: Displacement of the words from the start coordinate.
+   * sense: 0 to complement the words (reverse strand).
+   * Words out of the chromosome or with bases other than a, c, g or t are
+   * returned as "no". Nothing is allocated per word but its CHARSXP.
    * 
    */
   
-	int w,begin,nrowCooMet,nProt=0,Len,nElem, Xcg, x, MaxLen, sns;
-	int TargetLocat;
+	int w,nrowCooMet,nProt=0,Len,x,MaxLen,sns;
 	double *ColCoo;
 	SEXP MatSeq;
 	SEXP DicMet;
 	SEXP ColMet;
+	SEXP No;
 	
 	CooMet = PROTECT(coerceVector(CooMet, VECSXP)); nProt++;
 	// Separate target coordinates and methylation frequencies.
-	ColCoo = REAL(VECTOR_ELT(CooMet,0)); 	
+	// Coordinates may come as integers (ReadBedMethyl_cpp).
+	ColCoo = REAL(PROTECT(coerceVector(VECTOR_ELT(CooMet,0), REALSXP))); nProt++;
 	ColMet = VECTOR_ELT(CooMet,1); 
 
 	LenDic = PROTECT(coerceVector(LenDic, REALSXP)); nProt++;
 	w = REAL(LenDic)[0];
 	Len = 2*w + 2;
 
-	nElem=Len+1;
 	// Auxiliary structure for saving sequences.
-	char SubSeq[nElem];
+	char SubSeq[Len+1];
 
 	nrow = PROTECT(coerceVector(nrow, REALSXP)); nProt++;
 	nrowCooMet = REAL(nrow)[0];
-	// Structure for saving the real beginning coordinate of each word.
-	double *Sta = (double*)malloc(nrowCooMet*sizeof(double));
 
-	SeqChr = PROTECT(coerceVector(SeqChr,STRSXP)); nProt++;
-	SEXP c = STRING_ELT(SeqChr, 0);
-	const char *v = CHAR(c);
+	SeqSrc src;
+	if (TYPEOF(SeqChr) != VECSXP) {
+		SeqChr = PROTECT(coerceVector(SeqChr,STRSXP)); nProt++;
+	}
 
 	TargetGrowMode = PROTECT(coerceVector(TargetGrowMode,STRSXP)); nProt++;
-	SEXP TargetLoc = STRING_ELT(TargetGrowMode, 0);
-	const char *Target = CHAR(TargetLoc);
-	char TargetMode = Target[0];
+	char TargetMode = CHAR(STRING_ELT(TargetGrowMode, 0))[0];
+	if (TargetMode != 'C' && TargetMode != 'R' && TargetMode != 'L') {
+		UNPROTECT(nProt);
+		error("SeqDic: growing mode must be C, R or L");
+	}
 
 	X = PROTECT(coerceVector(X, REALSXP)); nProt++;
 	x = REAL(X)[0];
@@ -93,7 +77,12 @@ SEXP SeqDic(SEXP CooMet, SEXP LenDic, SEXP nrow, SEXP SeqChr, SEXP LenChr, SEXP
 	sns = REAL(sense)[0];
 	
 	LenChr = PROTECT(coerceVector(LenChr, REALSXP)); nProt++;
-	MaxLen = REAL(LenChr)[0];
+	double ChrLen = REAL(LenChr)[0];
+	if (seq_src_init(&src, SeqChr, &ChrLen) != 0) {
+		UNPROTECT(nProt);
+		error("SeqDic: invalid chromosome sequence");
+	}
+	MaxLen = ChrLen;
 
 	// Save space for a R structure-like string table.
 	MatSeq = PROTECT(allocVector(STRSXP, nrowCooMet)); nProt++;
@@ -101,112 +90,21 @@ SEXP SeqDic(SEXP CooMet, SEXP LenDic, SEXP nrow, SEXP SeqChr, SEXP LenChr, SEXP
 	// Structured to be returned, will contain the word and the methylation frequency.
 	DicMet = PROTECT(allocVector(VECSXP, 2)); nProt++;
 
-	// Extract word from the sequence depending on the growing mode.
-	switch( TargetMode)
-        {
-        	case 'C': // CENTRAL
-
-    // Get a word from each target coordinate.
-		for(int i=0; i<nrowCooMet; i++){ 
-
-			Xcg = ColCoo[i];
-		  
-		  // Check limits.
-			Sta[i] = Xcg + x - w - 1;
-			if (((Sta[i])<0) || ((Sta[i]+Len)>MaxLen)) {
-			  
-			  Sta[i]=-1;
-			  strcpy(SubSeq, "no");
-			  SubSeq[2] = '\0';
-			  
-			}
-			else {
-			  
-  			begin = Sta[i];
-  			strncpy(SubSeq, v+begin, Len);
-  			SubSeq[Len] = '\0';
-  			if (contains_wrong_chars(SubSeq, Len)){
-                            Sta[i]=-1;
-                            strcpy(SubSeq, "no");
-                            SubSeq[2] = '\0';
-                        }
-                        else if (sns==0){
-  			  strcpy(SubSeq, reverse_seq(SubSeq, Len));
-  			}
-			}
-		
-		  // Put the word in its position in the vector, according to the 
-		  // position of its target coordinate.
-			SET_STRING_ELT(MatSeq, i, mkChar(SubSeq));	
-		}
-		break;
+	No = PROTECT(mkChar("no")); nProt++;
 
-		case 'R': // LATERAL RIGHT
-	
-		for(int i=0; i<nrowCooMet; i++){ 
-	
-			Xcg = ColCoo[i];
-			begin = Xcg + x - 1;
-
-			if ((begin<0) || ((begin+Len)>MaxLen)) {
-			  
-			  //Sta[i]=-1;
-			  strcpy(SubSeq, "no");
-			  SubSeq[2] = '\0';
-			  
-			}
-			else {
-  			strncpy(SubSeq, v+begin, Len);
-  			SubSeq[Len] = '\0';
-  			 if (contains_wrong_chars(SubSeq, Len)){
-                            Sta[i]=-1;
-                            strcpy(SubSeq, "no");
-                            SubSeq[2] = '\0';
-                        }
-                        else if (sns==0){
-  			  strcpy(SubSeq, reverse_seq(SubSeq, Len));
-  			}
-  		
-  				
-			}
-			SET_STRING_ELT(MatSeq, i, mkChar(SubSeq));
-		}
-		break;
+	// Get a word from each target coordinate, starting where the growing
+	// mode says.
+	for(int i=0; i<nrowCooMet; i++){
 
-		case 'L': // LATERAL LEFT
-	
-		for(int i=0; i<nrowCooMet; i++){ 
-	
-			Xcg = ColCoo[i];
-			begin = Xcg + x - 2*w - 1;
-
-			if ((begin<0) || ((begin+Len)>MaxLen)) {
-			  
-			  //Sta[i]=-1;
-			  strcpy(SubSeq, "no");
-			  SubSeq[2] = '\0';
-			  
-			  
-			}
-			else{
-  			strncpy(SubSeq, v+begin, Len);
-  			SubSeq[Len] = '\0';
-  			 if (contains_wrong_chars(SubSeq, Len)){
-                            Sta[i]=-1;
-                            strcpy(SubSeq, "no");
-                            SubSeq[2] = '\0';
-                        }
-                        else if (sns==0){
-  			  strcpy(SubSeq, reverse_seq(SubSeq, Len));
-  			}
-  			
-  		
-  			
-			}
-			SET_STRING_ELT(MatSeq, i, mkChar(SubSeq));
+		// Check limits and bases.
+		if (seq_dic_windows(&src, MaxLen, TargetMode, ColCoo[i], x, w, w, sns==0, SubSeq) == 0) {
+			SET_STRING_ELT(MatSeq, i, No);
+			continue;
 		}
-		break;
 
+		// Put the word in its position in the vector, according to the 
+		// position of its target coordinate.
+		SET_STRING_ELT(MatSeq, i, mkCharLen(SubSeq, Len));
 	}
 
 	// First column of the return, words.
@@ -214,7 +112,7 @@ SEXP SeqDic(SEXP CooMet, SEXP LenDic, SEXP nrow, SEXP SeqChr, SEXP LenChr, SEXP
 	SET_VECTOR_ELT(DicMet,0,MatSeq);
 	SET_VECTOR_ELT(DicMet,1,ColMet);
 
-	free(Sta);
+	seq_src_free(&src);
 
 	UNPROTECT(nProt);
 
@@ -733,55 +631,9 @@ SEXP filtmdfile(SEXP NumAutosomes, SEXP dirmd){
 	return R_NilValue;
 }
 
-char Complementarity(char CharIn){
-
-	char CharOut;
-
-	switch(CharIn){
-
-    		case 'a'  :
-       		CharOut='t';
-       		break; 
-    		
-		case 'c'  :
-      		CharOut='g';
-       		break; 
-
-		case 'g' :
-		CharOut='c';
-		break;
-
-		case 't' :
-		CharOut='a';
-		break;
-		
-	  //case 'n' :
-	  //CharOut='n';
-	  //break;
-	}
-	return CharOut;
-}
-
-char *strrev (char *str){
-
-    char *begin = str;
-    char *end = str + strlen (str) - 1;
-    char tmp;
-
-    while (end > begin)
-    {
-        tmp = *end;
-        *end-- = *begin;
-        *begin++ = tmp;
-    }
-
-    return str;
-}
-
 SEXP Reverse(SEXP Seq, SEXP LenDic){
 
 	int nProt=0,nSeq,w,Len;
-	char CharIn,CharOut;
 	SEXP CompVecSeq;
 	SEXP c;
 
@@ -792,26 +644,18 @@ SEXP Reverse(SEXP Seq, SEXP LenDic){
 	w = REAL(LenDic)[0];
 	Len = 2*w + 2;
 
-	int nLen=Len+1;
-	char CharOutVec[nLen];
+	char CharOutVec[Len];
 
 	CompVecSeq = PROTECT(allocVector(STRSXP, nSeq)); nProt++;
 
 	for(int i1=0; i1<nSeq; i1++){
 
+		// Reverse complement of the first Len bases (fewer if the word
+		// is shorter).
 		c = STRING_ELT(Seq, i1);
-		const char *v = CHAR(c);
-
-		for(int i2=0; i2<Len; i2++){
-
-			CharIn=v[i2];
-			CharOut=Complementarity(CharIn);
-			CharOutVec[i2]=CharOut;
-			CharOutVec[Len] = '\0';
-		}
-
-		strrev(CharOutVec);
-	 	SET_STRING_ELT(CompVecSeq, i1, mkChar(CharOutVec));
+		int n = LENGTH(c) < Len ? LENGTH(c) : Len;
+		revcomp_ascii(CHAR(c), CharOutVec, n);
+	 	SET_STRING_ELT(CompVecSeq, i1, mkCharLen(CharOutVec, n));
 	}
 
 	UNPROTECT(nProt);
@@ -0,0 +1,461 @@
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <stdint.h>
+#include <cmath>
+#include <omp.h>
+#include "seqsrc.h"
+#include "kmer.h"
+
+using namespace Rcpp;
+using namespace std;
+
+#define DIC_WORD_CHUNK 4096
+
+// Counts of a word: number of targets, sum of their methylation and first
+// target (ordinal among the targets of all chromosomes).
+struct WordCell {
+    int freq;
+    double sum;
+    int first;
+};
+
+// Words of one width with the counts of each of their ntag tags (one, or
+// in canonical mode the two strands times the two orientations of a
+// canonical word). Open addressing with linear probing.
+struct WordTable {
+    int ntag;
+    vector<PackedKmer> key;
+    vector<unsigned char> used;
+    vector<WordCell> cell;   // ntag cells per slot
+    size_t n = 0;
+
+    WordTable(int ntag = 1) : ntag(ntag) {
+        alloc(1024);
+    }
+
+    void alloc(size_t cap) {
+        key.assign(cap, PackedKmer());
+        used.assign(cap, 0);
+        cell.assign(cap * ntag, WordCell());
+        n = 0;
+    }
+
+    WordCell* cells(size_t h) {
+        return &cell[h * ntag];
+    }
+
+    void add(const PackedKmer& k, int tag, int f, double s, int ord) {
+        if (2 * (n + 1) > key.size()) grow();
+        size_t mask = key.size() - 1;
+        size_t h = (size_t) kmer_hash(&k) & mask;
+        while (used[h] && !kmer_equal(&key[h], &k)) h = (h + 1) & mask;
+        WordCell* c = cells(h);
+        if (!used[h]) {
+            key[h] = k;
+            used[h] = 1;
+            for (int t = 0; t < ntag; t++) c[t] = {0, 0.0, INT_MAX};
+            n++;
+        }
+        c[tag].freq += f;
+        c[tag].sum += s;
+        c[tag].first = min(c[tag].first, ord);
+    }
+
+    void add(const PackedKmer& k, const WordCell* c) {
+        for (int t = 0; t < ntag; t++) {
+            if (c[t].freq != 0) add(k, t, c[t].freq, c[t].sum, c[t].first);
+        }
+    }
+
+    void merge(WordTable& other) {
+        for (size_t h = 0; h < other.key.size(); h++) {
+            if (other.used[h]) add(other.key[h], other.cells(h));
+        }
+        WordTable(ntag).swap(other);
+    }
+
+    void grow() {
+        WordTable bigger(ntag);
+        bigger.alloc(2 * key.size());
+        for (size_t h = 0; h < key.size(); h++) {
+            if (used[h]) bigger.add(key[h], cells(h));
+        }
+        swap(bigger);
+    }
+
+    void swap(WordTable& other) {
+        key.swap(other.key);
+        used.swap(other.used);
+        cell.swap(other.cell);
+        std::swap(n, other.n);
+    }
+};
+
+// Count-min sketch of the words of all the widths: an upper bound of the
+// count of each word, so that the words that cannot reach ThrFre are never
+// put in the hash tables. Counters saturate at DIC_SKETCH_MAX, and are
+// only compared with ThrFre.
+#define DIC_SKETCH_MAX 60000
+struct WordSketch {
+    static const int depth = 4;
+    int bits;
+    vector<uint16_t> cnt;
+
+    // For about n words, with at most 2^24 counters per row.
+    WordSketch(size_t n) : bits(16) {
+        if (n == 0) return;
+        while (bits < 24 && ((size_t) 1 << bits) < n) bits++;
+        cnt.assign((size_t) depth << bits, 0);
+    }
+
+    size_t slot(uint64_t h, int r) const {
+        static const uint64_t seed[depth] = {
+            0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+        };
+        return ((size_t) r << bits) + (size_t) ((h * seed[r]) >> (64 - bits));
+    }
+
+    // Called from the threads of one parallel region.
+    void add(uint64_t h) {
+        for (int r = 0; r < depth; r++) {
+            uint16_t& c = cnt[slot(h, r)];
+            uint16_t v;
+            #pragma omp atomic read
+            v = c;
+            if (v < DIC_SKETCH_MAX) {
+                #pragma omp atomic
+                c++;
+            }
+        }
+    }
+
+    int count(uint64_t h) const {
+        int m = INT_MAX;
+        for (int r = 0; r < depth; r++) m = min(m, (int) cnt[slot(h, r)]);
+        return m;
+    }
+};
+
+// Helper: hash of the cell of a word in the sketch (its key, tag and width).
+static inline uint64_t dic_sketch_hash(const PackedKmer& key, int tag, int w) {
+    uint64_t h = kmer_hash(&key) ^ ((uint64_t) (4 * w + tag) * 0xbf58476d1ce4e5b9ULL);
+    return h ^ (h >> 31);
+}
+
+// Widest valid window of a prone or resistant target, for SeqTot.
+struct TargetWord {
+    PackedKmer word;
+    int width;     // its width w; the narrower windows are inside it
+    int strand;    // index of its strand in CooMet
+    bool rev;      // of a reverse strand target, in canonical mode
+    bool prone;
+    bool resis;
+};
+
+// Targets of one strand, one chromosome per element.
+struct DicStrand {
+    vector<NumericVector> Coo, Met;
+};
+
+// Helper: key and orientation of the window k of a target. In canonical
+// mode the key is the smaller of the word of the target, read on its
+// strand in the orientation of DicWord_cpp (the window, complemented for
+// the reverse strand), and its complement on the other strand; the tag is
+// 1 if the word is the complement of the key. Otherwise the key is the
+// window.
+static inline void dic_key(const PackedKmer& k, int len, bool canonical, bool rev, PackedKmer* key, int* tag) {
+    if (!canonical) {
+        *key = k;
+        *tag = 0;
+        return;
+    }
+    PackedKmer comp;
+    kmer_comp(&k, len, &comp);
+    const PackedKmer& word = rev ? comp : k;
+    const PackedKmer& other = rev ? k : comp;
+    *tag = kmer_compare(&word, &other) > 0;
+    *key = *tag ? other : word;
+}
+
+// Helper: the word of a key and tag, as a CHARSXP.
+static inline SEXP dic_word(const PackedKmer& key, int tag, int len, char* buf) {
+    PackedKmer comp;
+    if (tag) kmer_comp(&key, len, &comp);
+    kmer_unpack(tag ? &comp : &key, len, buf);
+    return Rf_mkCharLen(buf, len);
+}
+
+static List dic_word_build(List Config, const vector<List>& CooMet, List SeqChr, bool comp, bool canonical) {
+    // Body of DicWord_cpp and DicWordCanonical_cpp: counts the words of the
+    // targets of each strand of CooMet (in canonical mode, the forward and
+    // the reverse strand), and returns the dictionaries of each strand.
+    int wMin = as<int>(Config["w_min"]);
+    int wMax = as<int>(Config["w_max"]);
+    int x = as<int>(Config["X"]);
+    double MethProne = as<double>(Config["MethProne"]);
+    double MethResis = as<double>(Config["MethResis"]);
+    int ThrFre = Config.containsElementNamed("ThrFre") ? as<int>(Config["ThrFre"]) : 1;
+    int nCPU = Config.containsElementNamed("nCPU") ? max(1, as<int>(Config["nCPU"])) : 1;
+    bool sketch = Config.containsElementNamed("SketchWords") && as<bool>(Config["SketchWords"]) &&
+        ThrFre > 1 && ThrFre <= DIC_SKETCH_MAX;
+    char mode = as<string>(Config["GrowingMode"])[0];
+    if (mode != 'C' && mode != 'L' && mode != 'R') {
+        stop("DicWord_cpp: GrowingMode must be C, R or L");
+    }
+    if (wMin < 1 || wMax < wMin || 2 * wMax + 2 > KMER_MAX_LEN) {
+        stop("DicWord_cpp: invalid word widths");
+    }
+    int nW = wMax - wMin + 1, LenW = 2 * wMax + 2;
+    int nStrand = CooMet.size();
+    // Cell of a word: 2 * strand + orientation in canonical mode.
+    int ntag = canonical ? 2 * nStrand : 1;
+
+    int nChr = CooMet[0].size();
+    for (int s = 1; s < nStrand; s++) {
+        if (CooMet[s].size() != nChr) stop("DicWord_cpp: both strands must have the same chromosomes");
+    }
+    if (SeqChr.size() < nChr) {
+        stop("DicWord_cpp: SeqChr has fewer chromosomes than CooMet");
+    }
+
+    // Coordinates and methylation of each strand and chromosome, and ordinal
+    // of their first target.
+    vector<DicStrand> strand(nStrand);
+    vector<vector<int> > Off(nStrand, vector<int>(nChr + 1, 0));
+    for (int s = 0; s < nStrand; s++) {
+        strand[s].Coo.resize(nChr);
+        strand[s].Met.resize(nChr);
+        for (int c = 0; c < nChr; c++) {
+            List df = CooMet[s][c];
+            strand[s].Coo[c] = as<NumericVector>(df[0]);
+            strand[s].Met[c] = as<NumericVector>(df[1]);
+            Off[s][c + 1] = Off[s][c] + strand[s].Coo[c].size();
+        }
+        if (s + 1 < nStrand) Off[s + 1][0] = Off[s][nChr];
+    }
+
+    // Sequence source of each chromosome.
+    vector<SeqSrc> src(nChr);
+    vector<int> MaxLen(nChr);
+    List Seqs(nChr);
+    for (int c = 0; c < nChr; c++) {
+        SEXP Seq = SeqChr[c];
+        if (TYPEOF(Seq) != VECSXP) {
+            Seq = Rf_coerceVector(Seq, STRSXP);
+            Seqs[c] = Seq;
+        }
+        double ChrLen = TYPEOF(Seq) == STRSXP && Rf_length(Seq) > 0 ? (double) LENGTH(STRING_ELT(Seq, 0)) : 0;
+        if (seq_src_init(&src[c], Seq, &ChrLen) != 0) {
+            for (int k = 0; k < c; k++) seq_src_free(&src[k]);
+            stop("DicWord_cpp: invalid sequence of chromosome %d", c + 1);
+        }
+        MaxLen[c] = (int) ChrLen;
+    }
+
+    // Chunks of targets of one strand and chromosome.
+    vector<int> ChunkStrand, ChunkChr, ChunkBeg;
+    for (int s = 0; s < nStrand; s++) {
+        for (int c = 0; c < nChr; c++) {
+            for (int i = 0; i < Off[s][c + 1] - Off[s][c]; i += DIC_WORD_CHUNK) {
+                ChunkStrand.push_back(s);
+                ChunkChr.push_back(c);
+                ChunkBeg.push_back(i);
+            }
+        }
+    }
+    int nChunk = ChunkChr.size();
+
+    int nThreads = nCPU;
+    vector<vector<WordTable> > tables(nThreads, vector<WordTable>(nW, WordTable(ntag)));
+    vector<vector<TargetWord> > selected(nChunk);
+
+    // With Config$SketchWords, a first pass over the targets only counts
+    // their words in the sketch, and the second one leaves out of the
+    // tables the words whose bound is under ThrFre, which are most of them
+    // for the wider windows.
+    WordSketch Sketch(sketch ? (size_t) Off[nStrand - 1][nChr] * nW : 0);
+
+    #pragma omp parallel num_threads(nThreads)
+    {
+        vector<WordTable>& table = tables[omp_get_thread_num()];
+        vector<char> buf(LenW + 1);
+        char* Win = buf.data();
+
+        for (int pass = sketch ? 0 : 1; pass < 2; pass++) {
+            bool counting = pass == 0;
+            #pragma omp for schedule(dynamic, 1)
+            for (int j = 0; j < nChunk; j++) {
+                int s = ChunkStrand[j], c = ChunkChr[j];
+                const DicStrand& st = strand[s];
+                bool rev = canonical && s == 1;
+                int end = min(ChunkBeg[j] + DIC_WORD_CHUNK, Off[s][c + 1] - Off[s][c]);
+                SeqSrc local;
+                seq_src_copy(&src[c], &local);
+
+                for (int i = ChunkBeg[j]; i < end; i++) {
+                    double m = st.Met[c][i];
+                    if (std::isnan(m)) continue;
+                    int coo = (int) st.Coo[c][i];
+
+                    // Number of valid widths from wMin, as SeqDic reads them.
+                    int v = seq_dic_windows(&local, MaxLen[c], mode, coo, x, wMin, wMax, comp, Win);
+                    if (v == 0) continue;
+
+                    int wTop = wMin + v - 1;
+                    char* top = Win + seq_dic_offset(mode, wTop, wMax);
+
+                    PackedKmer k;
+                    kmer_pack(top, 2 * wTop + 2, &k);
+                    int ord = Off[s][c] + i;
+                    for (int w = wMin; w <= wTop; w++) {
+                        PackedKmer kw, key;
+                        int tag;
+                        kmer_sub(&k, seq_dic_offset(mode, w, wTop), 2 * w + 2, &kw);
+                        dic_key(kw, 2 * w + 2, canonical, rev, &key, &tag);
+                        if (canonical) tag += 2 * s;
+                        if (counting) {
+                            Sketch.add(dic_sketch_hash(key, tag, w));
+                        } else if (!sketch || Sketch.count(dic_sketch_hash(key, tag, w)) >= ThrFre) {
+                            table[w - wMin].add(key, tag, 1, m, ord);
+                        }
+                    }
+
+                    bool prone = m >= MethProne, resis = m <= MethResis;
+                    if (!counting && (prone || resis)) {
+                        TargetWord t = {k, wTop, s, rev, prone, resis};
+                        selected[j].push_back(t);
+                    }
+                }
+                seq_src_free(&local);
+            }
+        }
+
+        // Merge the tables of every thread into those of thread 0.
+        #pragma omp for schedule(dynamic, 1)
+        for (int wi = 0; wi < nW; wi++) {
+            for (int t = 1; t < nThreads; t++) tables[0][wi].merge(tables[t][wi]);
+        }
+    }
+    for (int c = 0; c < nChr; c++) seq_src_free(&src[c]);
+
+    // One dictionary per strand in canonical mode, from the cells of its
+    // targets.
+    int nOut = canonical ? nStrand : 1;
+    vector<char> word(LenW + 1);
+    vector<List> SeqMetFreW, SeqPrn, SeqRes;
+    for (int so = 0; so < nOut; so++) {
+        SeqMetFreW.push_back(List(wMax));
+        SeqPrn.push_back(List(wMax));
+        SeqRes.push_back(List(wMax));
+    }
+    for (int w = wMin; w <= wMax; w++) {
+        int Len = 2 * w + 2;
+        WordTable& table = tables[0][w - wMin];
+        for (int so = 0; so < nOut; so++) {
+            vector<size_t> rows;   // cells, slot * ntag + tag
+            for (size_t h = 0; h < table.key.size(); h++) {
+                if (!table.used[h]) continue;
+                for (int t = canonical ? 2 * so : 0; t < (canonical ? 2 * so + 2 : ntag); t++) {
+                    if (table.cells(h)[t].freq >= max(1, ThrFre)) rows.push_back(h * ntag + t);
+                }
+            }
+            sort(rows.begin(), rows.end(), [&](size_t a, size_t b) { return table.cell[a].first < table.cell[b].first; });
+
+            int n = rows.size();
+            CharacterVector Seq(n);
+            NumericVector Methyl(n);
+            IntegerVector Freq(n), Index(n);
+            for (int r = 0; r < n; r++) {
+                const WordCell& cell = table.cell[rows[r]];
+                Seq[r] = dic_word(table.key[rows[r] / ntag], rows[r] % ntag % 2, Len, word.data());
+                Methyl[r] = cell.sum / cell.freq;
+                Freq[r] = cell.freq;
+                Index[r] = cell.first - Off[so][0] + 1;
+            }
+            SeqMetFreW[so][w - 1] = DataFrame::create(
+                Named("Seq") = Seq,
+                Named("Methyl") = Methyl,
+                Named("Freq") = Freq,
+                Named("Index") = Index
+            );
+
+            // Words of the prone and resistant targets, in target order.
+            int nPrn = 0, nRes = 0;
+            for (int j = 0; j < nChunk; j++) {
+                for (const TargetWord& t : selected[j]) {
+                    if (t.width < w || t.strand != so) continue;
+                    nPrn += t.prone;
+                    nRes += t.resis;
+                }
+            }
+            CharacterVector Prn(nPrn), Res(nRes);
+            int iPrn = 0, iRes = 0;
+            for (int j = 0; j < nChunk; j++) {
+                for (const TargetWord& t : selected[j]) {
+                    if (t.width < w || t.strand != so) continue;
+                    PackedKmer kw;
+                    kmer_sub(&t.word, seq_dic_offset(mode, w, t.width), Len, &kw);
+                    SEXP s = dic_word(kw, t.rev, Len, word.data());
+                    if (t.prone) Prn[iPrn++] = s;
+                    if (t.resis) Res[iRes++] = s;
+                }
+            }
+            SeqPrn[so][w - 1] = Prn;
+            SeqRes[so][w - 1] = Res;
+        }
+        WordTable(ntag).swap(table);
+    }
+
+    List Out(nOut);
+    for (int so = 0; so < nOut; so++) {
+        Out[so] = List::create(
+            Named("SeqMetFreW") = SeqMetFreW[so],
+            Named("SeqTot") = List::create(Named("SeqPrn") = SeqPrn[so], Named("SeqRes") = SeqRes[so])
+        );
+    }
+    return canonical ? List::create(Named("For") = Out[0], Named("Rev") = Out[1]) : as<List>(Out[0]);
+}
+
+// [[Rcpp::export]]
+List DicWord_cpp(List Config, List CooMet, List SeqChr, std::string Sense) {
+    // Compiles the word dictionaries of one strand: for each width w from
+    // Config$w_min to Config$w_max, the words of 2*w+2 bases around the
+    // targets of every chromosome (as SeqDic extracts them, complemented for
+    // Sense "rev"), with the number of targets of each word (Freq), the mean
+    // of their methylation (Methyl) and the ordinal, among all targets, of
+    // the first one (Index). Words seen fewer than Config$ThrFre times are
+    // left out, and words with bases other than a, c, g or t are not
+    // counted. Words are kept packed (kmer.h) in a hash table per thread
+    // and width, merged at the end; they are listed by Index. With
+    // Config$SketchWords, the words are first counted in a count-min sketch
+    // and those that cannot reach ThrFre never enter the tables, for the
+    // same result in less memory; it does nothing when ThrFre <= 1. The
+    // cap of Config$MaxWords words per width is not applied here but by
+    // ReduceWords, after the fusion.
+    //
+    // Returns list(SeqMetFreW, SeqTot): SeqMetFreW[[w]] is the
+    // data.frame(Seq, Methyl, Freq, Index) of width w; SeqTot$SeqPrn[[w]]
+    // and SeqTot$SeqRes[[w]] are the words of each prone (methylation >=
+    // Config$MethProne) and resistant (<= Config$MethResis) target.
+    vector<List> Strands(1, CooMet);
+    return dic_word_build(Config, Strands, SeqChr, Sense == "rev", false);
+}
+
+// [[Rcpp::export]]
+List DicWordCanonical_cpp(List Config, List CooMetFor, List CooMetRev, List SeqChr) {
+    // Dictionaries of both strands in one pass, in the orientation of
+    // DicWord_cpp (those of the reverse strand complemented, not reversed).
+    // A word and its complement share one key of the hash tables, and the
+    // counts of each strand and orientation are kept in their own cells,
+    // so the tables hold about half the keys of the two dictionaries of
+    // DicWord_cpp while each strand keeps its own counts. Returns
+    // list(For, Rev), each equal to the result of DicWord_cpp on CooMetFor
+    // (Sense "for") and on CooMetRev (Sense "rev").
+    vector<List> Strands;
+    Strands.push_back(CooMetFor);
+    Strands.push_back(CooMetRev);
+    return dic_word_build(Config, Strands, SeqChr, false, true);
+}
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "faidx.h"
+#include "fastaio.h"
+
+#define FAI_IO_BUF (1 << 20)
+// Bytes read ahead of a window when the reader buffer is refilled.
+#define FAI_READAHEAD (1 << 16)
+
+typedef struct {
+  FaiRecord *rec;
+  int n;
+  int cap;
+} FaiRecVec;
+
+static FaiRecord *fai_rec_push(FaiRecVec *v){
+
+  if (v->n == v->cap){
+    int cap = v->cap ? 2*v->cap : 32;
+    FaiRecord *rec = (FaiRecord*) realloc(v->rec, cap*sizeof(FaiRecord));
+    if (rec == NULL) return NULL;
+    v->rec = rec;
+    v->cap = cap;
+  }
+  memset(&v->rec[v->n], 0, sizeof(FaiRecord));
+  return &v->rec[v->n++];
+}
+
+static void fai_rec_free(FaiRecord *rec, int n){
+
+  for (int i = 0; i < n; i++) free(rec[i].name);
+  free(rec);
+}
+
+static int fai_scan(FILE *pF, FaiRecVec *v, char *err, size_t err_len){
+
+  /*
+   * fai_scan
+   * Scans a FASTA file and fills one FaiRecord per record. As samtools does,
+   * every sequence line of a record but the last one must have the same
+   * length.
+   */
+
+  unsigned char *in = (unsigned char*) malloc(FAI_IO_BUF);
+  char name[1024];
+  size_t name_len = 0, nIn, i;
+  uint64_t pos = 0, line_bytes = 0, line_bases = 0;
+  // short_line: a line shorter than linebases was seen in the current record.
+  int in_header = 0, name_done = 0, at_bol = 1, short_line = 0, status = 0;
+  FaiRecord *cur = NULL;
+
+  if (in == NULL){
+    snprintf(err, err_len, "out of memory");
+    return -1;
+  }
+
+  while (status == 0 && (nIn = fread(in, 1, FAI_IO_BUF, pF)) > 0){
+    for (i = 0; i < nIn; i++, pos++){
+      unsigned char c = in[i];
+
+      if (at_bol && c == '>'){
+        in_header = 1;
+        name_len = 0;
+        name_done = 0;
+        at_bol = 0;
+        continue;
+      }
+      at_bol = 0;
+
+      if (in_header){
+        if (c == '\n'){
+          name[name_len] = '\0';
+          if ((cur = fai_rec_push(v)) == NULL || (cur->name = strdup(name)) == NULL){
+            snprintf(err, err_len, "out of memory");
+            status = -1;
+            break;
+          }
+          cur->offset = pos + 1;
+          in_header = 0;
+          short_line = 0;
+          at_bol = 1;
+        }
+        else if (c == ' ' || c == '\t'){
+          // The name ends at the first blank, as for samtools.
+          if (name_len > 0) name_done = 1;
+        }
+        else if (!name_done && c != '\r' && name_len < sizeof(name) - 1){
+          name[name_len++] = (char) c;
+        }
+        continue;
+      }
+
+      line_bytes++;
+      if (c != '\n'){
+        if (c != '\r') line_bases++;
+        continue;
+      }
+
+      // End of a sequence line.
+      if (cur != NULL && line_bases > 0){
+        if (short_line || (cur->linebases > 0 && line_bases > cur->linebases)){
+          snprintf(err, err_len, "different line length in sequence '%s'", cur->name);
+          status = -1;
+          break;
+        }
+        if (cur->linebases == 0){
+          cur->linebases = (uint32_t) line_bases;
+          cur->linewidth = (uint32_t) line_bytes;
+        }
+        else if (line_bases < cur->linebases || line_bytes != cur->linewidth){
+          short_line = 1;
+        }
+        cur->length += line_bases;
+      }
+      else if (cur != NULL && cur->length > 0){
+        // Blank line inside a record: only allowed at its end.
+        short_line = 1;
+      }
+      line_bytes = line_bases = 0;
+      at_bol = 1;
+    }
+  }
+
+  // Last line without a newline.
+  if (status == 0 && cur != NULL && line_bases > 0){
+    if (short_line || (cur->linebases > 0 && line_bases > cur->linebases)){
+      snprintf(err, err_len, "different line length in sequence '%s'", cur->name);
+      status = -1;
+    }
+    else {
+      if (cur->linebases == 0){
+        cur->linebases = (uint32_t) line_bases;
+        cur->linewidth = (uint32_t) line_bytes + 1;
+      }
+      cur->length += line_bases;
+    }
+  }
+  if (status == 0 && ferror(pF)){
+    snprintf(err, err_len, "error while reading the FASTA file");
+    status = -1;
+  }
+
+  free(in);
+  return status;
+}
+
+int fai_build(const char *fasta_path, const char *fai_path, char *err, size_t err_len){
+
+  /*
+   * fai_build
+   * Writes the .fai index of a FASTA file.
+   */
+
+  FaiRecVec v = {NULL, 0, 0};
+  FILE *pF = fopen(fasta_path, "rb");
+  if (pF == NULL){
+    snprintf(err, err_len, "could not open file %s", fasta_path);
+    return -1;
+  }
+  int status = fai_scan(pF, &v, err, err_len);
+  fclose(pF);
+
+  if (status == 0){
+    FILE *pOut = fopen(fai_path, "w");
+    if (pOut == NULL){
+      snprintf(err, err_len, "cannot create index file %s", fai_path);
+      status = -1;
+    }
+    else {
+      for (int i = 0; i < v.n; i++){
+        fprintf(pOut, "%s\t%llu\t%llu\t%u\t%u\n", v.rec[i].name,
+                (unsigned long long) v.rec[i].length, (unsigned long long) v.rec[i].offset,
+                v.rec[i].linebases, v.rec[i].linewidth);
+      }
+      if (fclose(pOut) != 0){
+        snprintf(err, err_len, "cannot write index file %s", fai_path);
+        remove(fai_path);
+        status = -1;
+      }
+    }
+  }
+
+  fai_rec_free(v.rec, v.n);
+  return status;
+}
+
+static int fai_read_index(const char *fai_path, FaiRecVec *v, char *err, size_t err_len){
+
+  FILE *pF = fopen(fai_path, "r");
+  char line[2048], name[1024];
+  unsigned long long length, offset;
+  unsigned int linebases, linewidth;
+
+  if (pF == NULL){
+    snprintf(err, err_len, "could not open file %s", fai_path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), pF) != NULL){
+    if (sscanf(line, "%1023[^\t]\t%llu\t%llu\t%u\t%u", name, &length, &offset, &linebases, &linewidth) != 5 ||
+        (length > 0 && (linebases == 0 || linewidth < linebases))){
+      snprintf(err, err_len, "%s is not a valid index file", fai_path);
+      fclose(pF);
+      return -1;
+    }
+    FaiRecord *rec = fai_rec_push(v);
+    if (rec == NULL || (rec->name = strdup(name)) == NULL){
+      snprintf(err, err_len, "out of memory");
+      fclose(pF);
+      return -1;
+    }
+    rec->length = length;
+    rec->offset = offset;
+    rec->linebases = linebases;
+    rec->linewidth = linewidth;
+  }
+  fclose(pF);
+  return 0;
+}
+
+FaiIndex *fai_load(const char *fasta_path, char *err, size_t err_len){
+
+  /*
+   * fai_load
+   * Opens a FASTA file for windowed reads, building its index if needed.
+   */
+
+  size_t n = strlen(fasta_path);
+  char *fai_path = (char*) malloc(n + 5);
+  FaiRecVec v = {NULL, 0, 0};
+  FaiIndex *fai = NULL;
+
+  if (fai_path == NULL){
+    snprintf(err, err_len, "out of memory");
+    return NULL;
+  }
+  if (fa_is_compressed(fasta_path)){
+    // Offsets of a compressed file do not map to the uncompressed sequence.
+    snprintf(err, err_len, "%s is compressed; decompress it or use a packed genome", fasta_path);
+    free(fai_path);
+    return NULL;
+  }
+  memcpy(fai_path, fasta_path, n);
+  memcpy(fai_path + n, ".fai", 5);
+
+  if (access(fai_path, R_OK) != 0 && fai_build(fasta_path, fai_path, err, err_len) != 0){
+    free(fai_path);
+    return NULL;
+  }
+  if (fai_read_index(fai_path, &v, err, err_len) != 0){
+    fai_rec_free(v.rec, v.n);
+    free(fai_path);
+    return NULL;
+  }
+  free(fai_path);
+
+  int fd = open(fasta_path, O_RDONLY);
+  if (fd < 0){
+    snprintf(err, err_len, "could not open file %s", fasta_path);
+    fai_rec_free(v.rec, v.n);
+    return NULL;
+  }
+  fai = (FaiIndex*) malloc(sizeof(FaiIndex));
+  if (fai == NULL){
+    snprintf(err, err_len, "out of memory");
+    close(fd);
+    fai_rec_free(v.rec, v.n);
+    return NULL;
+  }
+  fai->fd = fd;
+  fai->n_record = v.n;
+  fai->records = v.rec;
+  return fai;
+}
+
+void fai_close(FaiIndex *fai){
+
+  if (fai == NULL) return;
+  close(fai->fd);
+  fai_rec_free(fai->records, fai->n_record);
+  free(fai);
+}
+
+int fai_record_index(const FaiIndex *fai, const char *name){
+
+  for (int i = 0; i < fai->n_record; i++){
+    if (strcmp(fai->records[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+void fai_reader_init(FaiReader *rd, const FaiIndex *fai, int rid){
+
+  rd->fai = fai;
+  rd->rid = rid;
+  rd->buf = NULL;
+  rd->buf_cap = 0;
+  rd->buf_off = 0;
+  rd->buf_len = 0;
+}
+
+void fai_reader_free(FaiReader *rd){
+
+  free(rd->buf);
+  rd->buf = NULL;
+  rd->buf_cap = rd->buf_len = 0;
+}
+
+static uint64_t fai_file_offset(const FaiRecord *rec, uint64_t p){
+  return rec->offset + (p / rec->linebases) * rec->linewidth + p % rec->linebases;
+}
+
+int fai_reader_fetch(FaiReader *rd, int64_t begin, int len, char *out){
+
+  /*
+   * fai_reader_fetch
+   * Copies a window of the record, skipping the line ends of the file.
+   */
+
+  if (rd->rid < 0 || rd->rid >= rd->fai->n_record || begin < 0 || len < 0) return -1;
+  const FaiRecord *rec = &rd->fai->records[rd->rid];
+  if ((uint64_t) begin + (uint64_t) len > rec->length) return -1;
+  out[len] = '\0';
+  if (len == 0) return 0;
+
+  uint64_t first = fai_file_offset(rec, (uint64_t) begin);
+  uint64_t last = fai_file_offset(rec, (uint64_t) begin + len - 1) + 1;
+
+  if (first < rd->buf_off || last > rd->buf_off + rd->buf_len){
+    // Refill: the window plus some read-ahead for the following windows.
+    uint64_t rec_end = fai_file_offset(rec, rec->length - 1) + 1;
+    uint64_t end = last + FAI_READAHEAD < rec_end ? last + FAI_READAHEAD : rec_end;
+    size_t need = (size_t) (end - first);
+    if (need > rd->buf_cap){
+      char *buf = (char*) realloc(rd->buf, need);
+      if (buf == NULL) return -1;
+      rd->buf = buf;
+      rd->buf_cap = need;
+    }
+    size_t got = 0;
+    while (got < need){
+      ssize_t r = pread(rd->fai->fd, rd->buf + got, need - got, (off_t) (first + got));
+      if (r <= 0) break;
+      got += (size_t) r;
+    }
+    rd->buf_off = first;
+    rd->buf_len = got;
+    if (last > rd->buf_off + rd->buf_len) return -1;
+  }
+
+  uint64_t p = (uint64_t) begin;
+  int i = 0;
+  while (i < len){
+    size_t in_line = rec->linebases - p % rec->linebases;
+    size_t n = in_line < (size_t) (len - i) ? in_line : (size_t) (len - i);
+    memcpy(out + i, rd->buf + (fai_file_offset(rec, p) - rd->buf_off), n);
+    i += (int) n;
+    p += n;
+  }
+  // change to lowercase
+  for (i = 0; i < len; i++){
+    unsigned char c = (unsigned char) out[i];
+    out[i] = (char) (c | (((unsigned char) (c - 'A') < 26) << 5));
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef DMMD_FAIDX_H
+#define DMMD_FAIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Indexed FASTA access.
+ *
+ * The index is a samtools faidx compatible ".fai" file next to the FASTA
+ * file, with one tab separated line per record:
+ *
+ *  name  length  offset  linebases  linewidth
+ *
+ * where offset is the file offset of the first base, linebases the number
+ * of bases per line and linewidth the number of bytes per line (newline
+ * included). With it, any window of a record is read with a single pread
+ * instead of loading the whole chromosome.
+ */
+
+typedef struct {
+  char *name;
+  uint64_t length;
+  uint64_t offset;
+  uint32_t linebases;
+  uint32_t linewidth;
+} FaiRecord;
+
+typedef struct {
+  int fd;
+  int n_record;
+  FaiRecord *records;
+} FaiIndex;
+
+/* Reader of windows of one record. Windows are served from a buffer of the
+ * file, refilled with pread on a miss, so that windows requested in
+ * increasing order only read each page of the file once. */
+typedef struct {
+  const FaiIndex *fai;
+  int rid;
+  char *buf;
+  size_t buf_cap;
+  uint64_t buf_off;
+  size_t buf_len;
+} FaiReader;
+
+/* Writes the .fai index of a FASTA file. Returns 0 on success. */
+int fai_build(const char *fasta_path, const char *fai_path, char *err, size_t err_len);
+
+/* Opens a FASTA file and loads fasta_path.fai, building it first if it does
+ * not exist. Returns NULL on failure. */
+FaiIndex *fai_load(const char *fasta_path, char *err, size_t err_len);
+void fai_close(FaiIndex *fai);
+
+/* Index of the record called name, or -1. */
+int fai_record_index(const FaiIndex *fai, const char *name);
+
+void fai_reader_init(FaiReader *rd, const FaiIndex *fai, int rid);
+void fai_reader_free(FaiReader *rd);
+
+/* Reads len bases of the record starting at begin (0-based) into out,
+ * lowercased and NUL terminated. out must hold len+1 chars. Returns 0, or -1
+ * if the window is out of range or cannot be read. */
+int fai_reader_fetch(FaiReader *rd, int64_t begin, int len, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <omp.h>
+#include "fastaio.h"
+
+// Blocks inflated per thread and batch.
+#define FA_BLOCKS_PER_THREAD 16
+#define FA_BGZF_MAX_BLOCK 65536
+
+enum { FA_PLAIN, FA_GZIP, FA_BGZF };
+
+typedef struct {
+  size_t cdata;     // offset of the deflate data in the compressed batch
+  size_t clen;      // length of the deflate data
+  size_t uoff;      // offset of the block in the uncompressed batch
+  uint32_t crc;
+  uint32_t isize;
+} FaBlock;
+
+struct FaStream {
+  int mode;
+  int n_threads;
+  FILE *pF;
+  gzFile gz;
+  char err[256];
+  int failed;
+
+  // BGZF batch.
+  unsigned char *cbuf;
+  size_t cbuf_cap;
+  unsigned char *ubuf;
+  size_t ubuf_cap;
+  size_t ubuf_len;
+  size_t ubuf_pos;
+  FaBlock *blocks;
+  int max_blocks;
+  int eof;
+};
+
+static uint16_t fa_le16(const unsigned char *p){ return (uint16_t) (p[0] | (p[1] << 8)); }
+static uint32_t fa_le32(const unsigned char *p){
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int fa_bgzf_bsize(const unsigned char *extra, int xlen){
+
+  // BSIZE (total block size - 1) from the "BC" subfield, or -1.
+  int i = 0;
+  while (i + 4 <= xlen){
+    int slen = fa_le16(extra + i + 2);
+    if (extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 && i + 6 <= xlen) return fa_le16(extra + i + 4);
+    i += 4 + slen;
+  }
+  return -1;
+}
+
+static int fa_detect(FILE *pF){
+
+  /*
+   * fa_detect
+   * Plain, gzip or BGZF, from the first bytes of the file.
+   */
+
+  unsigned char hdr[18];
+  size_t n = fread(hdr, 1, sizeof(hdr), pF);
+  rewind(pF);
+  if (n < 2 || hdr[0] != 0x1f || hdr[1] != 0x8b) return FA_PLAIN;
+  if (n == 18 && hdr[2] == 8 && (hdr[3] & 4) && fa_le16(hdr + 10) >= 6 &&
+      hdr[12] == 'B' && hdr[13] == 'C' && fa_le16(hdr + 14) == 2) return FA_BGZF;
+  return FA_GZIP;
+}
+
+FaStream *fa_stream_open(const char *path, int n_threads, char *err, size_t err_len){
+
+  FaStream *fs = (FaStream*) calloc(1, sizeof(FaStream));
+  if (fs == NULL){
+    snprintf(err, err_len, "out of memory");
+    return NULL;
+  }
+  fs->n_threads = n_threads > 0 ? n_threads : 1;
+  fs->pF = fopen(path, "rb");
+  if (fs->pF == NULL){
+    snprintf(err, err_len, "could not open file %s", path);
+    free(fs);
+    return NULL;
+  }
+  fs->mode = fa_detect(fs->pF);
+
+  if (fs->mode == FA_GZIP){
+    fclose(fs->pF);
+    fs->pF = NULL;
+    fs->gz = gzopen(path, "rb");
+    if (fs->gz == NULL){
+      snprintf(err, err_len, "could not open file %s", path);
+      free(fs);
+      return NULL;
+    }
+    gzbuffer(fs->gz, 1 << 20);
+  }
+  else if (fs->mode == FA_BGZF){
+    fs->max_blocks = fs->n_threads * FA_BLOCKS_PER_THREAD;
+    fs->blocks = (FaBlock*) malloc(fs->max_blocks * sizeof(FaBlock));
+    fs->cbuf_cap = (size_t) fs->max_blocks * FA_BGZF_MAX_BLOCK;
+    fs->cbuf = (unsigned char*) malloc(fs->cbuf_cap);
+    fs->ubuf_cap = (size_t) fs->max_blocks * FA_BGZF_MAX_BLOCK;
+    fs->ubuf = (unsigned char*) malloc(fs->ubuf_cap);
+    if (fs->blocks == NULL || fs->cbuf == NULL || fs->ubuf == NULL){
+      snprintf(err, err_len, "out of memory");
+      fa_stream_close(fs);
+      return NULL;
+    }
+  }
+  return fs;
+}
+
+static int fa_bgzf_fill(FaStream *fs){
+
+  /*
+   * fa_bgzf_fill
+   * Reads the next batch of BGZF blocks and inflates them in parallel.
+   * Returns 1 if it gave some data, 0 if it did not (empty blocks or end of
+   * file), -1 on error.
+   */
+
+  int nb = 0;
+  size_t clen = 0, ulen = 0;
+  unsigned char hdr[12], extra[FA_BGZF_MAX_BLOCK];
+
+  while (nb < fs->max_blocks){
+    size_t n = fread(hdr, 1, sizeof(hdr), fs->pF);
+    if (n == 0){ fs->eof = 1; break; }
+    if (n != sizeof(hdr) || hdr[0] != 0x1f || hdr[1] != 0x8b || hdr[2] != 8 || !(hdr[3] & 4)){
+      snprintf(fs->err, sizeof(fs->err), "invalid BGZF block header");
+      return -1;
+    }
+    int xlen = fa_le16(hdr + 10);
+    if (fread(extra, 1, xlen, fs->pF) != (size_t) xlen){
+      snprintf(fs->err, sizeof(fs->err), "truncated BGZF block");
+      return -1;
+    }
+    int bsize = fa_bgzf_bsize(extra, xlen);
+    // Remaining: deflate data, CRC32 and ISIZE.
+    long rest = (long) bsize + 1 - 12 - xlen;
+    if (bsize < 0 || rest < 8){
+      snprintf(fs->err, sizeof(fs->err), "invalid BGZF block header");
+      return -1;
+    }
+    if (fread(fs->cbuf + clen, 1, (size_t) rest, fs->pF) != (size_t) rest){
+      snprintf(fs->err, sizeof(fs->err), "truncated BGZF block");
+      return -1;
+    }
+    FaBlock *b = &fs->blocks[nb++];
+    b->cdata = clen;
+    b->clen = (size_t) rest - 8;
+    b->crc = fa_le32(fs->cbuf + clen + rest - 8);
+    b->isize = fa_le32(fs->cbuf + clen + rest - 4);
+    if (b->isize > FA_BGZF_MAX_BLOCK){
+      snprintf(fs->err, sizeof(fs->err), "invalid BGZF block size");
+      return -1;
+    }
+    b->uoff = ulen;
+    clen += (size_t) rest;
+    ulen += b->isize;
+  }
+
+  int bad = 0;
+  #pragma omp parallel for schedule(static) num_threads(fs->n_threads) reduction(|:bad) if(nb > 1)
+  for (int i = 0; i < nb; i++){
+    FaBlock *b = &fs->blocks[i];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK){ bad = 1; continue; }
+    zs.next_in = fs->cbuf + b->cdata;
+    zs.avail_in = (uInt) b->clen;
+    zs.next_out = fs->ubuf + b->uoff;
+    zs.avail_out = (uInt) b->isize;
+    int ret = inflate(&zs, Z_FINISH);
+    if (ret != Z_STREAM_END || zs.total_out != b->isize ||
+        crc32(crc32(0L, Z_NULL, 0), fs->ubuf + b->uoff, b->isize) != b->crc) bad = 1;
+    inflateEnd(&zs);
+  }
+  if (bad){
+    snprintf(fs->err, sizeof(fs->err), "corrupted BGZF block");
+    return -1;
+  }
+
+  fs->ubuf_len = ulen;
+  fs->ubuf_pos = 0;
+  return ulen > 0 ? 1 : 0;
+}
+
+long fa_stream_read(FaStream *fs, void *buf, size_t len){
+
+  if (fs->failed) return -1;
+
+  if (fs->mode == FA_PLAIN){
+    size_t n = fread(buf, 1, len, fs->pF);
+    if (n == 0 && ferror(fs->pF)){
+      snprintf(fs->err, sizeof(fs->err), "error while reading the file");
+      fs->failed = 1;
+      return -1;
+    }
+    return (long) n;
+  }
+
+  if (fs->mode == FA_GZIP){
+    unsigned int chunk = len > (1u << 30) ? (1u << 30) : (unsigned int) len;
+    int n = gzread(fs->gz, buf, chunk);
+    // A truncated stream ends without an error from gzread: it is left in
+    // gzerror (Z_BUF_ERROR).
+    int errnum = Z_OK;
+    const char *msg = n > 0 ? NULL : gzerror(fs->gz, &errnum);
+    if (n < 0 || errnum != Z_OK){
+      snprintf(fs->err, sizeof(fs->err), "%s", msg);
+      fs->failed = 1;
+      return -1;
+    }
+    return n;
+  }
+
+  // BGZF: serve the current batch, decoding the next one when it runs out.
+  size_t done = 0;
+  while (done < len){
+    if (fs->ubuf_pos == fs->ubuf_len){
+      if (fs->eof) break;
+      // Empty blocks (such as the end-of-file marker) give empty batches.
+      int ret = fa_bgzf_fill(fs);
+      if (ret < 0){ fs->failed = 1; return -1; }
+      continue;
+    }
+    size_t n = fs->ubuf_len - fs->ubuf_pos;
+    if (n > len - done) n = len - done;
+    memcpy((unsigned char*) buf + done, fs->ubuf + fs->ubuf_pos, n);
+    fs->ubuf_pos += n;
+    done += n;
+  }
+  return (long) done;
+}
+
+const char *fa_stream_error(const FaStream *fs){
+  return fs->err;
+}
+
+void fa_stream_close(FaStream *fs){
+
+  if (fs == NULL) return;
+  if (fs->pF != NULL) fclose(fs->pF);
+  if (fs->gz != NULL) gzclose(fs->gz);
+  free(fs->cbuf);
+  free(fs->ubuf);
+  free(fs->blocks);
+  free(fs);
+}
+
+int fa_is_compressed(const char *path){
+
+  unsigned char magic[2];
+  FILE *pF = fopen(path, "rb");
+  if (pF == NULL) return 0;
+  size_t n = fread(magic, 1, 2, pF);
+  fclose(pF);
+  return n == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+int fa_path_resolve(const char *path, char *out, size_t out_len){
+
+  snprintf(out, out_len, "%s", path);
+  if (access(path, R_OK) == 0) return 0;
+  snprintf(out, out_len, "%s.gz", path);
+  if (access(out, R_OK) == 0) return 0;
+  snprintf(out, out_len, "%s", path);
+  return -1;
+}
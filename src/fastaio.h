@@ -0,0 +1,46 @@
+#ifndef DMMD_FASTAIO_H
+#define DMMD_FASTAIO_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Byte stream over a plain, gzip or BGZF compressed file (FASTA files, and
+ * also the methylation call files).
+ *
+ * BGZF files (bgzip, the format of samtools) are a series of independent
+ * deflate blocks of at most 64 KB, each one carrying its compressed size in
+ * the gzip extra field and its uncompressed size in the footer. They are
+ * read in batches of blocks, and the blocks of a batch are inflated in
+ * parallel. Other gzip files are inflated serially by zlib.
+ */
+
+typedef struct FaStream FaStream;
+
+/* Opens path. n_threads is the number of threads that inflate BGZF blocks.
+ * Returns NULL on failure. */
+FaStream *fa_stream_open(const char *path, int n_threads, char *err, size_t err_len);
+
+/* Reads up to len bytes of uncompressed data. Returns the number of bytes
+ * read, 0 at the end of the file or -1 on error (see fa_stream_error). */
+long fa_stream_read(FaStream *fs, void *buf, size_t len);
+
+const char *fa_stream_error(const FaStream *fs);
+void fa_stream_close(FaStream *fs);
+
+/* Nonzero if path starts with the gzip magic number. */
+int fa_is_compressed(const char *path);
+
+/* Writes to out the path of the FASTA file to read for path: path itself if
+ * it exists, else path.gz if that exists. Returns 0, or -1 if neither exists
+ * (out is then path). */
+int fa_path_resolve(const char *path, char *out, size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,59 @@
 #include <Rcpp.h> 
 #include <omp.h>
 #include <iterator>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include "kmer.h"
 using namespace Rcpp;
 
 
+// Start of the word of width w in the word of width w + 1, and of its
+// frequency vector in that of the word of width w + 1, for grow_mode 0
+// (C), 1 (L) or 2 (R), as in FuseSeq.
+static inline int fuse_start(int grow_mode) {
+  
+  switch(grow_mode){
+  case 1: //L
+    return 2;
+  case 2: //R
+    return 0;
+  default: //C
+    return 1;
+  }
+}
+
+// Fuses into the word ind_next of width w + 1 all its words of width w,
+// str_indexes[subindexes[ind_next]..subindexes[ind_next+1]), in that
+// order. Frequency and methylation accumulate over them in double.
+static void fuse_seq(int ind_next, int motif_length, int start_next,
+                     const IntegerVector& str_indexes, const IntegerVector& subindexes,
+                     const IntegerVector& fre_w, const NumericVector& sg_w, const IntegerMatrix& fre_w_vec,
+                     IntegerVector& fre_w_next, NumericVector& sg_w_next, IntegerMatrix& fre_w_vec_next) {
+  
+  double fr_next = fre_w_next[ind_next];
+  double sg_next = sg_w_next[ind_next];
+  
+  for (int k = subindexes[ind_next]; k < subindexes[ind_next + 1]; k++ ){
+    
+    int ind_current = str_indexes[k];
+    double fr = fre_w[ind_current];
+    double sg = sg_w[ind_current];
+    
+    sg_next = (fr*sg+fr_next*sg_next)/(fr+fr_next);
+    fr_next += fr;
+    
+    for (int j = start_next; j < (motif_length + start_next); j ++){
+      fre_w_vec_next(ind_next, j) = fre_w_vec_next(ind_next, j) + fre_w_vec(ind_current, j-start_next);
+    }
+  }
+  
+  sg_w_next[ind_next] = sg_next;
+  fre_w_next[ind_next] = (int) fr_next;
+}
+
 // [[Rcpp::export]]
 void fuse_seqs_seq( int motif_length, int grow_mode, IntegerVector str_indexes, IntegerVector subindexes, IntegerVector ind_not_void, 
                     IntegerVector fre_w, NumericVector sg_w, IntegerMatrix fre_w_vec,
@@ -11,46 +61,11 @@ void fuse_seqs_seq( int motif_length, int grow_mode, IntegerVector str_indexes,
                     int num_cpu) {
   
   int len_next = ind_not_void.size();
+  int start_next = fuse_start(grow_mode);
   
-  int i_start, i_end, k, i, ind_next, ind_current, j, start_next;
-  int fr, fr_next;
-  float sg, sg_next;
-  
-  for (i = 0; i < len_next; i++){
-    
-    ind_next = ind_not_void[i];
-    i_start = subindexes[ind_next];
-    i_end = subindexes[ind_next + 1];
-    fr_next = fre_w_next[ind_next];
-    sg_next = sg_w_next[ind_next];
-    
-    for (k = i_start; k < i_end; k++ ){
-      
-      ind_current = str_indexes[k];
-      fr = fre_w[ind_current];
-      sg = sg_w[ind_current];
-      
-      sg_w_next[ind_next] = (fr*sg+fr_next*sg_next)/(fr+fr_next);
-      switch(grow_mode){
-      case 0: //C
-        start_next = 1;
-        break;
-      case 1: //L
-        start_next = 0;
-        break;
-      case 2: //R
-        start_next = 2;
-        break;
-      }
-      
-      for (j = start_next; j < (motif_length + start_next); j ++){
-        fre_w_vec_next(ind_next, j) = fre_w_vec_next(ind_next, j) + fre_w_vec(ind_current, j-start_next);
-      }
-      
-      fre_w_next[ind_next] = fr_next + fr;
-      
-    }
-    
+  for (int i = 0; i < len_next; i++){
+    fuse_seq(ind_not_void[i], motif_length, start_next, str_indexes, subindexes,
+             fre_w, sg_w, fre_w_vec, fre_w_next, sg_w_next, fre_w_vec_next);
   }
 }
 
@@ -61,54 +76,91 @@ void fuse_seqs_openmp( int motif_length, int grow_mode, IntegerVector str_indexe
                        IntegerVector fre_w_next, NumericVector sg_w_next, IntegerMatrix fre_w_vec_next,
                        int num_cpu) {
   
+  // fuse_seqs_seq on num_cpu threads. Each word of width w + 1 is fused
+  // by one thread, so the result is that of fuse_seqs_seq for any number
+  // of threads. The number of words fused into each one is very uneven,
+  // so the words are handed out to the threads in small chunks as they
+  // finish.
+  
   int len_next = ind_not_void.size();
+  int start_next = fuse_start(grow_mode);
   
-  int i_start, i_end, k, i, ind_next, ind_current, j, start_next;
-  int fr, fr_next;
-  float sg, sg_next;
+#pragma omp parallel for num_threads(num_cpu) schedule(dynamic, 64)
+  for (int i = 0; i < len_next; i++){
+    fuse_seq(ind_not_void[i], motif_length, start_next, str_indexes, subindexes,
+             fre_w, sg_w, fre_w_vec, fre_w_next, sg_w_next, fre_w_vec_next);
+  }
+}
+
+
+// Frequency vectors (FreWVec) of the words of one width in delta form:
+// list(Base, RowPtr, Col, Val, Len). The vector of word i has Len
+// positions, each one Base[i] plus the sum of the deltas Val[p] with
+// Col[p] <= position, for p in [RowPtr[i], RowPtr[i+1]), sorted by Col.
+// Words start as constants with no deltas (FreqVec), and fusion only adds
+// a few deltas per fused word, so the n x Len matrix is only built for the
+// data frames of Fusion_cpp.
+
+// Adds to out the deltas of the first len positions of the vector of word
+// i, shifted to start in a vector of out_len positions.
+static void frewvec_shifted(const int* base, const int* row_ptr, const int* col, const int* val,
+                            int i, int start, int len, int out_len,
+                            std::vector< std::pair<int, int> >& out) {
   
-#pragma omp parallel num_threads(num_cpu)
-#pragma omp for private(i_start, i_end, k, i, ind_next, ind_current, j, start_next, fr, fr_next, sg, sg_next)
-  for (i = 0; i < len_next; i++){
-    
-    ind_next = ind_not_void[i];
-    i_start = subindexes[ind_next];
-    i_end = subindexes[ind_next + 1];
-    fr_next = fre_w_next[ind_next];
-    sg_next = sg_w_next[ind_next];
-    
-    for (k = i_start; k < i_end; k++ ){
-      
-      ind_current = str_indexes[k];
-      fr = fre_w[ind_current];
-      sg = sg_w[ind_current];
-      
-      sg_w_next[ind_next] = (fr*sg+fr_next*sg_next)/(fr+fr_next);
-      switch(grow_mode){
-      case 0: //C
-        start_next = 1;
-        break;
-      case 1: //L
-        start_next = 0;
-        break;
-      case 2: //R
-        start_next = 2;
-        break;
+  int value = base[i];
+  out.push_back(std::make_pair(start, value));
+  for (int p = row_ptr[i]; p < row_ptr[i + 1] && col[p] < len; p++) {
+    out.push_back(std::make_pair(start + col[p], val[p]));
+    value += val[p];
+  }
+  if (start + len < out_len) out.push_back(std::make_pair(start + len, -value));
+}
+
+// Sorts the deltas of d by position, with one delta per position.
+static void frewvec_merge(std::vector< std::pair<int, int> >& d) {
+  
+  std::sort(d.begin(), d.end());
+  size_t m = 0;
+  for (size_t q = 0; q < d.size(); q++) {
+    if (m > 0 && d[m - 1].first == d[q].first) d[m - 1].second += d[q].second;
+    else d[m++] = d[q];
+  }
+  d.resize(m);
+}
+
+// Deltas of n words, those of the words in rows (fused[q] for rows[q])
+// replaced and the others as in row_ptr, col and val.
+static void frewvec_splice(const int* row_ptr, const int* col, const int* val, int n,
+                           const int* rows, const std::vector< std::vector< std::pair<int, int> > >& fused,
+                           std::vector<int>& new_row_ptr, std::vector<int>& new_col, std::vector<int>& new_val) {
+  
+  std::vector<int> fused_row(n, -1);
+  for (size_t q = 0; q < fused.size(); q++) fused_row[rows[q]] = (int) q;
+  
+  new_row_ptr.assign(n + 1, 0);
+  for (int r = 0; r < n; r++) {
+    int nnz = fused_row[r] >= 0 ? (int) fused[fused_row[r]].size() : row_ptr[r + 1] - row_ptr[r];
+    new_row_ptr[r + 1] = new_row_ptr[r] + nnz;
+  }
+  new_col.resize(new_row_ptr[n]);
+  new_val.resize(new_row_ptr[n]);
+  for (int r = 0; r < n; r++) {
+    int o = new_row_ptr[r];
+    if (fused_row[r] >= 0) {
+      const std::vector< std::pair<int, int> >& d = fused[fused_row[r]];
+      for (size_t q = 0; q < d.size(); q++, o++) {
+        new_col[o] = d[q].first;
+        new_val[o] = d[q].second;
       }
-      
-      for (j = start_next; j < (motif_length + start_next); j ++){
-        fre_w_vec_next(ind_next, j) = fre_w_vec_next(ind_next, j) + fre_w_vec(ind_current, j-start_next);
+    } else {
+      for (int p = row_ptr[r]; p < row_ptr[r + 1]; p++, o++) {
+        new_col[o] = col[p];
+        new_val[o] = val[p];
       }
-      
-      fre_w_next[ind_next] = fr_next + fr;
-      
     }
-    
   }
-  
 }
 
-
 // [[Rcpp::export]]
 List find_strings_seq( StringVector in_str, StringVector out_str ) {
   
@@ -186,26 +238,28 @@ List find_strings_par( StringVector in_str, StringVector out_str, int num_cpu )
   std::vector < int > str_indexes;
   std::vector < int > subindexes;
   std::vector < int > ind_not_void;
-  std::vector < int > ids_per_thread (omp_get_max_threads());
-  std::vector < int > ids_next_per_thread (omp_get_max_threads());
-  num_cpu = omp_get_num_threads();
+  std::vector < int > ids_per_thread (std::max(num_cpu, 1));
+  std::vector < int > ids_next_per_thread (std::max(num_cpu, 1));
+  // Threads of the team, only known inside the parallel region.
+  int num_threads = 1;
   
-  // omp_set_num_threads(num_cpu);
-  
-#pragma omp parallel
+#pragma omp parallel num_threads(num_cpu)
 {
 
+#pragma omp single
+  num_threads = omp_get_num_threads();
+  
   size_t i, j;
   
   int counter = 0;
   int new_size;
   int next_seq_counter = 0;
   int prev_counter = counter;
-  int current_size = int(len_out*3/num_cpu);
+  int current_size = std::max(int(len_out*3/num_threads), 16);
   int not_void_counter = 0;
   std::vector < int > str_indexes_priv (current_size);
-  std::vector < int > ind_not_void_priv (int(len_out/num_cpu)+1);
-  std::vector < int > subindexes_priv (int(len_out/num_cpu)+1);
+  std::vector < int > ind_not_void_priv (int(len_out/num_threads)+1);
+  std::vector < int > subindexes_priv (int(len_out/num_threads)+1);
   // int str_indexes_priv[current_size];
   // int ind_not_void_priv[int(len_out/num_cpu)+1];
   // int subindexes_priv[int(len_out/num_cpu)+1];
@@ -220,7 +274,7 @@ List find_strings_par( StringVector in_str, StringVector out_str, int num_cpu )
         // resize index vector
         if (!( counter < current_size )){
           new_size = int(current_size + current_size / 2);
-          str_indexes_priv.resize(current_size);
+          str_indexes_priv.resize(new_size);
           // resize_int_array(str_indexes_priv, current_size, new_size);
           current_size = new_size;
         }
@@ -241,7 +295,7 @@ List find_strings_par( StringVector in_str, StringVector out_str, int num_cpu )
   // resize_int_array(subindexes_priv,int(len_out/num_cpu)+1,next_seq_counter);
 
 #pragma omp for schedule(static) ordered
-  for(int i=0; i<omp_get_num_threads(); i++) {
+  for(int i=0; i<num_threads; i++) {
 #pragma omp ordered
 
     ids_next_per_thread[omp_get_thread_num()] = next_seq_counter;
@@ -260,7 +314,7 @@ List find_strings_par( StringVector in_str, StringVector out_str, int num_cpu )
 int accum_ids = ids_per_thread[0];
 int accum_ids_next = ids_next_per_thread[0];
 
-for (int idc = 1; idc < num_cpu; idc++ ){
+for (int idc = 1; idc < num_threads; idc++ ){
   
   int end_id = accum_ids_next + ids_next_per_thread[idc];
   
@@ -292,6 +346,478 @@ return ret;
 }
 
 
+// Hash of the bytes of a string (FNV-1a).
+static inline uint64_t str_hash(const char* s, int len) {
+  uint64_t h = 1469598103934665603ULL;
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Hash join of the strings out (out_chr, out_len) with the strings in:
+// the indexes of the strings of in equal to out[i] are
+// str_indexes[subindexes[i]..subindexes[i+1]), in increasing order, and
+// ind_not_void has the i with at least one. The strings of in are put in
+// a hash table once, and the strings of out look up their equal ones
+// there on num_cpu threads.
+static void str_join(const std::vector<const char*>& in_chr, const std::vector<int>& in_len,
+                     const std::vector<const char*>& out_chr, const std::vector<int>& out_len, int num_cpu,
+                     std::vector<int>& str_indexes, std::vector<int>& subindexes, std::vector<int>& ind_not_void) {
+  
+  int len_in = in_chr.size();
+  int len_out = out_chr.size();
+  
+  // Open addressing table with the first index of each distinct string of
+  // in; the indexes of the same string follow in next_equal, in
+  // increasing order.
+  size_t n_slot = 16;
+  while (n_slot < 2 * (size_t) len_in) n_slot *= 2;
+  size_t mask = n_slot - 1;
+  std::vector < int > slot (n_slot, -1);
+  std::vector < int > last_equal (n_slot, -1);
+  std::vector < int > next_equal (len_in, -1);
+  
+  for (int j = 0; j < len_in; j++){
+    size_t h = (size_t) str_hash(in_chr[j], in_len[j]) & mask;
+    while (slot[h] >= 0){
+      int k = slot[h];
+      if (in_len[k] == in_len[j] && memcmp(in_chr[k], in_chr[j], in_len[j]) == 0) break;
+      h = (h + 1) & mask;
+    }
+    if (slot[h] < 0) slot[h] = j;
+    else next_equal[last_equal[h]] = j;
+    last_equal[h] = j;
+  }
+  
+  // First index of the strings of in equal to each one of out.
+  std::vector < int > first (len_out, -1);
+  subindexes.assign(len_out + 1, 0);
+  
+#pragma omp parallel for num_threads(num_cpu) schedule(static)
+  for (int i = 0; i < len_out; i++){
+    size_t h = (size_t) str_hash(out_chr[i], out_len[i]) & mask;
+    while (slot[h] >= 0){
+      int k = slot[h];
+      if (in_len[k] == out_len[i] && memcmp(in_chr[k], out_chr[i], out_len[i]) == 0){
+        first[i] = k;
+        break;
+      }
+      h = (h + 1) & mask;
+    }
+    int n_equal = 0;
+    for (int k = first[i]; k >= 0; k = next_equal[k]) n_equal++;
+    subindexes[i + 1] = n_equal;
+  }
+  
+  ind_not_void.clear();
+  for (int i = 0; i < len_out; i++){
+    if (subindexes[i + 1] > 0) ind_not_void.push_back(i);
+    subindexes[i + 1] += subindexes[i];
+  }
+  
+  str_indexes.resize(subindexes[len_out]);
+  
+#pragma omp parallel for num_threads(num_cpu) schedule(static)
+  for (int i = 0; i < len_out; i++){
+    int counter = subindexes[i];
+    for (int k = first[i]; k >= 0; k = next_equal[k]) str_indexes[counter++] = k;
+  }
+}
+
+// [[Rcpp::plugins(openmp)]]
+// [[Rcpp::export]]
+List find_strings_hash( StringVector in_str, StringVector out_str, int num_cpu ) {
+  
+  // find_strings_seq as a hash join (see str_join). The output is the
+  // same as that of find_strings_seq.
+  
+  int len_in = in_str.size();
+  int len_out = out_str.size();
+  
+  // Strings are read here, as the R API is not to be used in the threads.
+  std::vector < const char* > in_chr (len_in), out_chr (len_out);
+  std::vector < int > in_len (len_in), out_len (len_out);
+  for (int j = 0; j < len_in; j++){
+    SEXP s = STRING_ELT(in_str, j);
+    in_chr[j] = CHAR(s);
+    in_len[j] = LENGTH(s);
+  }
+  for (int i = 0; i < len_out; i++){
+    SEXP s = STRING_ELT(out_str, i);
+    out_chr[i] = CHAR(s);
+    out_len[i] = LENGTH(s);
+  }
+  
+  std::vector < int > str_indexes, subindexes, ind_not_void;
+  str_join(in_chr, in_len, out_chr, out_len, num_cpu, str_indexes, subindexes, ind_not_void);
+  
+  // Each string of in_str is found by all the equal strings of out_str.
+  std::vector < int > seqs_to_rm;
+  std::vector < char > found (len_in, 0);
+  for (size_t c = 0; c < str_indexes.size(); c++) found[str_indexes[c]] = 1;
+  for (int j = 0; j < len_in; j++)
+    if (found[j]) seqs_to_rm.push_back(j + 1);
+  
+  List ret;
+  ret["str_indexes"] = str_indexes;
+  ret["subindexes"] = subindexes;
+  ret["ind_not_void"] = ind_not_void;
+  ret["seqs_to_rm"] = seqs_to_rm;
+  return ret;
+}
+
+
+// Words of one width in Fusion_cpp: the rows still kept of the data frame
+// of the width, with their methylation, frequency and frequency vector in
+// delta form (see frewvec_shifted).
+struct FusionWidth {
+  CharacterVector seq;
+  IntegerVector ind;
+  std::vector<int> rows;
+  std::vector<double> met;
+  std::vector<int> fre;
+  std::vector<int> base, row_ptr, col, val;
+  int len;
+};
+
+static void fusion_width_read(SEXP df, SEXP fre_vec, int w, FusionWidth& W) {
+  
+  W.len = 2*w + 2;
+  if (Rf_isNull(df) || Rf_length(df) < 4 || Rf_length(VECTOR_ELT(df, 0)) == 0) return;
+  
+  List Df(df);
+  W.seq = as<CharacterVector>(Df[0]);
+  NumericVector met = as<NumericVector>(Df[1]);
+  IntegerVector fre = as<IntegerVector>(Df[2]);
+  W.ind = as<IntegerVector>(Df[3]);
+  int n = W.seq.size();
+  
+  W.rows.resize(n);
+  for (int i = 0; i < n; i++) W.rows[i] = i;
+  W.met.assign(met.begin(), met.end());
+  W.fre.assign(fre.begin(), fre.end());
+  
+  if (Rf_isNull(fre_vec)) {
+    // Constant vectors, as built by FreqVec.
+    W.base = W.fre;
+    W.row_ptr.assign(n + 1, 0);
+    return;
+  }
+  List v(fre_vec);
+  IntegerVector base = v["Base"], row_ptr = v["RowPtr"], col = v["Col"], val = v["Val"];
+  if (base.size() != n) stop("FreVecW[[%d]] does not have a vector per word", w);
+  W.base.assign(base.begin(), base.end());
+  W.row_ptr.assign(row_ptr.begin(), row_ptr.end());
+  W.col.assign(col.begin(), col.end());
+  W.val.assign(val.begin(), val.end());
+}
+
+// Data frame of the kept words of W, with columns SeqW, MetW, FreW, IndW
+// and X1..X<len> for their frequency vectors, as built by Fusion.
+static List fusion_width_frame(const FusionWidth& W) {
+  
+  int n = W.rows.size();
+  List out(4 + W.len);
+  CharacterVector names(4 + W.len);
+  
+  CharacterVector seq(n);
+  NumericVector met(n);
+  IntegerVector fre(n), ind(n);
+  for (int i = 0; i < n; i++) {
+    SET_STRING_ELT(seq, i, STRING_ELT(W.seq, W.rows[i]));
+    met[i] = W.met[i];
+    fre[i] = W.fre[i];
+    ind[i] = W.ind[W.rows[i]];
+  }
+  out[0] = seq; out[1] = met; out[2] = fre; out[3] = ind;
+  names[0] = "SeqW"; names[1] = "MetW"; names[2] = "FreW"; names[3] = "IndW";
+  
+  std::vector<int*> vec(W.len);
+  for (int j = 0; j < W.len; j++) {
+    IntegerVector x(n);
+    vec[j] = x.begin();
+    out[4 + j] = x;
+    names[4 + j] = "X" + std::to_string(j + 1);
+  }
+  for (int i = 0; i < n; i++) {
+    int value = W.base[i];
+    int p = W.row_ptr[i];
+    for (int j = 0; j < W.len; j++) {
+      while (p < W.row_ptr[i + 1] && W.col[p] == j) value += W.val[p++];
+      vec[j][i] = value;
+    }
+  }
+  
+  out.attr("names") = names;
+  out.attr("row.names") = IntegerVector::create(NA_INTEGER, -n);
+  out.attr("class") = "data.frame";
+  return out;
+}
+
+// Keeps the words of W with keep set.
+static void fusion_width_keep(FusionWidth& W, const std::vector<char>& keep) {
+  
+  int n = W.rows.size();
+  int m = 0, nnz = 0;
+  for (int i = 0; i < n; i++) {
+    if (!keep[i]) continue;
+    int p0 = W.row_ptr[i], p1 = W.row_ptr[i + 1];
+    W.rows[m] = W.rows[i];
+    W.met[m] = W.met[i];
+    W.fre[m] = W.fre[i];
+    W.base[m] = W.base[i];
+    W.row_ptr[m] = nnz;
+    for (int p = p0; p < p1; p++, nnz++) {
+      W.col[nnz] = W.col[p];
+      W.val[nnz] = W.val[p];
+    }
+    m++;
+  }
+  W.row_ptr[m] = nnz;
+  W.rows.resize(m); W.met.resize(m); W.fre.resize(m); W.base.resize(m);
+  W.row_ptr.resize(m + 1); W.col.resize(nnz); W.val.resize(nnz);
+}
+
+// Sorted index of the packed words (kmer.h) of one width, built once and
+// shared by the fusions of all the growing modes. Rows are those of the
+// data frame of the width: a width is only compacted after it has been
+// fused into the next one, so the index is valid whenever it is used.
+struct FusionIndex {
+  bool packed;
+  std::vector<PackedKmer> key;     // word of each row
+  std::vector<PackedKmer> sorted;  // keys in increasing order
+  std::vector<int> order;          // row of each sorted key, increasing for equal keys
+};
+
+static void fusion_index_build(const FusionWidth& W, int w, int num_cpu, FusionIndex& I) {
+  
+  int n = W.rows.size();
+  I.packed = 2*w + 2 <= KMER_MAX_LEN;
+  if (!I.packed || n == 0) return;
+  
+  std::vector<const char*> chr(n);
+  std::vector<int> len(n);
+  for (int i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(W.seq, W.rows[i]);
+    chr[i] = CHAR(s);
+    len[i] = LENGTH(s);
+  }
+  
+  I.key.resize(n);
+  int failed = 0;
+#pragma omp parallel for num_threads(num_cpu) schedule(static) reduction(+:failed)
+  for (int i = 0; i < n; i++)
+    if (len[i] != 2*w + 2 || kmer_pack(chr[i], len[i], &I.key[i]) != 0) failed++;
+  // Words that do not pack are joined as strings (str_join).
+  if (failed > 0) {
+    I.packed = false;
+    I.key.clear();
+    return;
+  }
+  
+  I.order.resize(n);
+  for (int i = 0; i < n; i++) I.order[i] = i;
+  const std::vector<PackedKmer>& key = I.key;
+  std::stable_sort(I.order.begin(), I.order.end(),
+                   [&key](int a, int b) { return kmer_compare(&key[a], &key[b]) < 0; });
+  I.sorted.resize(n);
+  for (int q = 0; q < n; q++) I.sorted[q] = key[I.order[q]];
+}
+
+// str_join over packed words: the words in (the index of width w) equal
+// to the 2*w+2 bases at start of each word out (of width w + 1), found by
+// binary search in the sorted keys of in.
+static void kmer_join(const FusionIndex& in, const FusionIndex& out, int start, int len, int num_cpu,
+                      std::vector<int>& str_indexes, std::vector<int>& subindexes, std::vector<int>& ind_not_void) {
+  
+  int len_out = out.key.size();
+  std::vector<int> first(len_out, 0);
+  subindexes.assign(len_out + 1, 0);
+  
+#pragma omp parallel for num_threads(num_cpu) schedule(static)
+  for (int i = 0; i < len_out; i++) {
+    PackedKmer k;
+    kmer_sub(&out.key[i], start, len, &k);
+    std::pair<std::vector<PackedKmer>::const_iterator, std::vector<PackedKmer>::const_iterator> eq =
+      std::equal_range(in.sorted.begin(), in.sorted.end(), k, PackedKmerLess());
+    first[i] = eq.first - in.sorted.begin();
+    subindexes[i + 1] = eq.second - eq.first;
+  }
+  
+  ind_not_void.clear();
+  for (int i = 0; i < len_out; i++) {
+    if (subindexes[i + 1] > 0) ind_not_void.push_back(i);
+    subindexes[i + 1] += subindexes[i];
+  }
+  
+  str_indexes.resize(subindexes[len_out]);
+  
+#pragma omp parallel for num_threads(num_cpu) schedule(static)
+  for (int i = 0; i < len_out; i++) {
+    int counter = subindexes[i];
+    for (int q = first[i]; counter < subindexes[i + 1]; q++) str_indexes[counter++] = in.order[q];
+  }
+}
+
+// Start of the word of width w in the word of width w + 1, and in its
+// frequency vector, for each growing mode.
+static int fusion_start(const std::string& mode) {
+  
+  if (mode == "C") return 1;
+  if (mode == "L") return 2;
+  if (mode == "R") return 0;
+  stop("Unknown GrowingMode %s", mode.c_str());
+  return 0;
+}
+
+// Fusion of the words W (a copy, changed here) of all the widths for the
+// growing mode with the given start. Returns the list of data frames of
+// Fusion.
+static List fusion_run(std::vector<FusionWidth> W, const std::vector<FusionIndex>& I,
+                       int w_min, int w_max, int start, int num_cpu) {
+  
+  List out(w_max);
+  
+  for (int w = w_min; w < w_max; w++) {
+    
+    FusionWidth& cur = W[w];
+    FusionWidth& next = W[w + 1];
+    int n = cur.rows.size();
+    int n_next = next.rows.size();
+    if (n == 0) continue;
+    
+    std::vector<int> str_indexes, subindexes, ind_not_void;
+    std::vector<int> in_len(n);
+    for (int i = 0; i < n; i++) in_len[i] = LENGTH(STRING_ELT(cur.seq, cur.rows[i]));
+    
+    if (I[w].packed && (I[w + 1].packed || n_next == 0)) {
+      kmer_join(I[w], I[w + 1], start, 2*w + 2, num_cpu, str_indexes, subindexes, ind_not_void);
+    } else {
+      // Words of width w, and inner words of width w + 1.
+      std::vector<const char*> in_chr(n), out_chr(n_next);
+      std::vector<int> out_len(n_next);
+      for (int i = 0; i < n; i++) in_chr[i] = CHAR(STRING_ELT(cur.seq, cur.rows[i]));
+      for (int i = 0; i < n_next; i++) {
+        SEXP s = STRING_ELT(next.seq, next.rows[i]);
+        int len = LENGTH(s) - start;
+        out_chr[i] = CHAR(s) + std::min(start, LENGTH(s));
+        out_len[i] = std::max(0, std::min(len, 2*w + 2));
+      }
+      str_join(in_chr, in_len, out_chr, out_len, num_cpu, str_indexes, subindexes, ind_not_void);
+    }
+    
+    int n_fused = ind_not_void.size();
+    std::vector< std::vector< std::pair<int, int> > > fused(n_fused);
+    
+#pragma omp parallel for num_threads(num_cpu) schedule(dynamic, 256)
+    for (int q = 0; q < n_fused; q++) {
+      
+      int r = ind_not_void[q];
+      double fr_next = next.fre[r];
+      double sg_next = next.met[r];
+      std::vector< std::pair<int, int> >& d = fused[q];
+      
+      for (int p = next.row_ptr[r]; p < next.row_ptr[r + 1]; p++)
+        d.push_back(std::make_pair(next.col[p], next.val[p]));
+      
+      for (int k = subindexes[r]; k < subindexes[r + 1]; k++) {
+        int c = str_indexes[k];
+        double fr = cur.fre[c];
+        sg_next = (fr*cur.met[c] + fr_next*sg_next)/(fr + fr_next);
+        fr_next += fr;
+        frewvec_shifted(cur.base.data(), cur.row_ptr.data(), cur.col.data(), cur.val.data(),
+                        c, start, cur.len, next.len, d);
+      }
+      next.met[r] = sg_next;
+      next.fre[r] = (int) fr_next;
+      frewvec_merge(d);
+    }
+    
+    std::vector<int> row_ptr, col, val;
+    frewvec_splice(next.row_ptr.data(), next.col.data(), next.val.data(), n_next,
+                   ind_not_void.data(), fused, row_ptr, col, val);
+    next.row_ptr.swap(row_ptr);
+    next.col.swap(col);
+    next.val.swap(val);
+    
+    // The fused words of width w are dropped, as are void ones.
+    std::vector<char> keep(n, 1);
+    for (size_t k = 0; k < str_indexes.size(); k++) keep[str_indexes[k]] = 0;
+    for (int i = 0; i < n; i++)
+      if (in_len[i] == 0) keep[i] = 0;
+    fusion_width_keep(cur, keep);
+    
+    out[w - 1] = fusion_width_frame(cur);
+    if (w == w_max - 1) out[w_max - 1] = fusion_width_frame(next);
+  }
+  
+  return out;
+}
+
+// Reads the words of all the widths, and indexes them.
+static void fusion_read(List Config, List SeqMetFreW, List FreVecW,
+                        std::vector<FusionWidth>& W, std::vector<FusionIndex>& I) {
+  
+  int w_min = as<int>(Config["w_min"]);
+  int w_max = as<int>(Config["w_max"]);
+  int num_cpu = as<int>(Config["nCPU"]);
+  
+  W.resize(w_max + 1);
+  I.resize(w_max + 1);
+  for (int w = w_min; w <= w_max; w++) {
+    SEXP df = w - 1 < SeqMetFreW.size() ? (SEXP) SeqMetFreW[w - 1] : R_NilValue;
+    SEXP fre_vec = w - 1 < FreVecW.size() ? (SEXP) FreVecW[w - 1] : R_NilValue;
+    fusion_width_read(df, fre_vec, w, W[w]);
+    fusion_index_build(W[w], w, num_cpu, I[w]);
+  }
+}
+
+// [[Rcpp::plugins(openmp)]]
+// [[Rcpp::export]]
+List Fusion_cpp( List Config, List SeqMetFreW, List FreVecW ) {
+  
+  // Fusion of all the widths in one call. For each width w from w_min to
+  // w_max - 1, the words of width w + 1 whose inner word (their 2*w+2 bases
+  // without the two grown by GrowingMode) is a word of width w take its
+  // frequency, methylation and frequency vector, as in FuseSeq, and those
+  // words of width w are dropped. The words of a width are only read from
+  // R once, and kept in delta form (see frewvec_shifted) until their data
+  // frame is built.
+  // Returns the list of data frames of Fusion.
+  
+  std::vector<FusionWidth> W;
+  std::vector<FusionIndex> I;
+  fusion_read(Config, SeqMetFreW, FreVecW, W, I);
+  
+  return fusion_run(W, I, as<int>(Config["w_min"]), as<int>(Config["w_max"]),
+                    fusion_start(as<std::string>(Config["GrowingMode"])), as<int>(Config["nCPU"]));
+}
+
+// [[Rcpp::plugins(openmp)]]
+// [[Rcpp::export]]
+List FusionModes_cpp( List Config, List SeqMetFreW, List FreVecW, CharacterVector Modes ) {
+  
+  // Fusion_cpp for each growing mode in Modes ("C", "L" or "R"), over the
+  // same words. The words are read and indexed once for all the modes.
+  // Returns the list of Fusion_cpp's results, named by mode.
+  
+  std::vector<FusionWidth> W;
+  std::vector<FusionIndex> I;
+  fusion_read(Config, SeqMetFreW, FreVecW, W, I);
+  
+  int w_min = as<int>(Config["w_min"]);
+  int w_max = as<int>(Config["w_max"]);
+  int num_cpu = as<int>(Config["nCPU"]);
+  
+  List out(Modes.size());
+  for (int m = 0; m < Modes.size(); m++)
+    out[m] = fusion_run(W, I, w_min, w_max, fusion_start(as<std::string>(Modes[m])), num_cpu);
+  out.attr("names") = Modes;
+  return out;
+}
+
 /*** R
 
 # w = 2
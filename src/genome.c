@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "genome.h"
+#include "fastaio.h"
+
+#define PG_IO_BUF (1 << 20)
+
+static const char pg_base_chr[4] = {'a', 'c', 'g', 't'};
+
+static int pg_base_code(unsigned char c){
+
+  /*
+   * pg_base_code
+   * 2-bit code of a base, or -1 if it is not a, c, g or t.
+   */
+
+  switch(c){
+    case 'a': case 'A': return 0;
+    case 'c': case 'C': return 1;
+    case 'g': case 'G': return 2;
+    case 't': case 'T': return 3;
+  }
+  return -1;
+}
+
+typedef struct {
+  PgRun *runs;
+  uint64_t n;
+  uint64_t cap;
+} PgRunVec;
+
+static int pg_run_push(PgRunVec *v, uint64_t pos){
+
+  // Extend the last run if pos is contiguous to it.
+  if (v->n > 0 && v->runs[v->n-1].start + v->runs[v->n-1].length == pos){
+    v->runs[v->n-1].length++;
+    return 0;
+  }
+  if (v->n == v->cap){
+    uint64_t cap = v->cap ? 2*v->cap : 64;
+    PgRun *runs = (PgRun*) realloc(v->runs, cap*sizeof(PgRun));
+    if (runs == NULL) return -1;
+    v->runs = runs;
+    v->cap = cap;
+  }
+  v->runs[v->n].start = pos;
+  v->runs[v->n].length = 1;
+  v->n++;
+  return 0;
+}
+
+static int pg_pack_fasta(FILE *pOut, const char *fasta_path, int n_threads, PgContig *contig, PgRunVec *runs,
+                         char *err, size_t err_len){
+
+  /*
+   * pg_pack_fasta
+   * Streams the first record of a FASTA file into pOut as 2-bit codes.
+   * Arguments:
+   *  pOut: destination file, positioned where the contig data starts.
+   *  fasta_path: FASTA file of the contig, plain or gzip/BGZF compressed.
+   *  n_threads: threads inflating BGZF blocks.
+   *  contig: entry of the contig table to be filled (length).
+   *  runs: receives the n-runs of the contig.
+   * Returns 1 if the FASTA file could not be opened, -1 on I/O errors
+   * (described in err).
+   */
+
+  FaStream *pF = fa_stream_open(fasta_path, n_threads, err, err_len);
+  if (pF == NULL) return 1;
+
+  unsigned char *in = (unsigned char*) malloc(PG_IO_BUF);
+  unsigned char *out = (unsigned char*) malloc(PG_IO_BUF);
+  if (in == NULL || out == NULL){
+    free(in); free(out); fa_stream_close(pF);
+    snprintf(err, err_len, "out of memory");
+    return -1;
+  }
+
+  // 0: start of line, 1: inside a header line, 2: inside a sequence line, 3: done.
+  int state = 0, seen_record = 0, status = 0;
+  uint64_t pos = 0;
+  size_t nOut = 0, i;
+  long nIn = 0;
+  unsigned char acc = 0;
+
+  while (state != 3 && (nIn = fa_stream_read(pF, in, PG_IO_BUF)) > 0){
+    for (i = 0; i < (size_t) nIn && state != 3; i++){
+      unsigned char c = in[i];
+
+      if (c == '\n'){
+        if (state == 1) seen_record = 1;
+        state = 0;
+        continue;
+      }
+      if (state == 0 && c == '>'){
+        // A second header ends the first record.
+        state = seen_record ? 3 : 1;
+        continue;
+      }
+      if (state == 1) continue;
+      state = 2;
+      if (c == '\r' || c == ' ' || c == '\t') continue;
+
+      int code = pg_base_code(c);
+      if (code < 0){
+        code = 0;
+        if (pg_run_push(runs, pos) != 0){
+          snprintf(err, err_len, "out of memory");
+          status = -1; state = 3; break;
+        }
+      }
+      acc |= (unsigned char)(code << (2*(pos & 3)));
+      pos++;
+      if ((pos & 3) == 0){
+        out[nOut++] = acc;
+        acc = 0;
+        if (nOut == PG_IO_BUF){
+          if (fwrite(out, 1, nOut, pOut) != nOut){
+            snprintf(err, err_len, "cannot write packed genome file");
+            status = -1; state = 3; break;
+          }
+          nOut = 0;
+        }
+      }
+    }
+  }
+  if (status == 0 && nIn < 0){
+    snprintf(err, err_len, "%s: %s", fasta_path, fa_stream_error(pF));
+    status = -1;
+  }
+  if ((pos & 3) != 0) out[nOut++] = acc;
+  if (status == 0 && nOut > 0 && fwrite(out, 1, nOut, pOut) != nOut){
+    snprintf(err, err_len, "cannot write packed genome file");
+    status = -1;
+  }
+
+  contig->length = pos;
+
+  free(in);
+  free(out);
+  fa_stream_close(pF);
+  return status;
+}
+
+int pg_build(const char *out_path, int n_contig, const char *const *names,
+             const char *const *fasta_paths, int n_threads, char *err, size_t err_len){
+
+  /*
+   * pg_build
+   * Builds a packed genome file. The contig table is written last, once the
+   * offsets of every section are known.
+   */
+
+  for (int j = 0; j < n_contig; j++){
+    if (strlen(names[j]) >= PG_NAME_LEN){
+      snprintf(err, err_len, "contig name %s is longer than %d characters", names[j], PG_NAME_LEN-1);
+      return -1;
+    }
+  }
+
+  PgContig *contigs = (PgContig*) calloc(n_contig > 0 ? n_contig : 1, sizeof(PgContig));
+  PgRunVec *runs = (PgRunVec*) calloc(n_contig > 0 ? n_contig : 1, sizeof(PgRunVec));
+  FILE *pOut = fopen(out_path, "wb");
+  int i, status = 0;
+  uint32_t version = PG_VERSION, nc = (uint32_t) n_contig;
+  static const unsigned char zeros[8] = {0};
+
+  if (contigs == NULL || runs == NULL || pOut == NULL){
+    snprintf(err, err_len, "cannot create packed genome file %s", out_path);
+    status = -1;
+    goto done;
+  }
+
+  // Reserve the header and the contig table.
+  fwrite(PG_MAGIC, 1, 8, pOut);
+  fwrite(&version, sizeof(uint32_t), 1, pOut);
+  fwrite(&nc, sizeof(uint32_t), 1, pOut);
+  fwrite(contigs, sizeof(PgContig), n_contig, pOut);
+
+  for (i = 0; i < n_contig; i++){
+    strcpy(contigs[i].name, names[i]);
+    contigs[i].seq_offset = (uint64_t) ftello(pOut);
+    int ret = pg_pack_fasta(pOut, fasta_paths[i], n_threads, &contigs[i], &runs[i], err, err_len);
+    if (ret < 0){
+      status = -1;
+      goto done;
+    }
+    if (ret > 0){
+      // Missing contig: keep an empty entry and report it.
+      snprintf(err, err_len, "could not open file %s", fasta_paths[i]);
+      status = 1;
+    }
+  }
+
+  // n-run tables, 8-byte aligned so that they can be read in place.
+  for (i = 0; i < n_contig; i++){
+    off_t off = ftello(pOut);
+    if (off % 8) fwrite(zeros, 1, 8 - off % 8, pOut);
+    contigs[i].nrun_offset = (uint64_t) ftello(pOut);
+    contigs[i].nrun_count = runs[i].n;
+    if (runs[i].n > 0 && fwrite(runs[i].runs, sizeof(PgRun), runs[i].n, pOut) != runs[i].n){
+      snprintf(err, err_len, "cannot write packed genome file %s", out_path);
+      status = -1;
+      goto done;
+    }
+  }
+
+  fseeko(pOut, 16, SEEK_SET);
+  if (fwrite(contigs, sizeof(PgContig), n_contig, pOut) != (size_t) n_contig){
+    snprintf(err, err_len, "cannot write packed genome file %s", out_path);
+    status = -1;
+  }
+
+done:
+  if (pOut != NULL && fclose(pOut) != 0 && status >= 0){
+    snprintf(err, err_len, "cannot write packed genome file %s", out_path);
+    status = -1;
+  }
+  if (runs != NULL){
+    for (i = 0; i < n_contig; i++) free(runs[i].runs);
+    free(runs);
+  }
+  free(contigs);
+  if (status < 0) remove(out_path);
+  return status;
+}
+
+PackedGenome *pg_open(const char *path, char *err, size_t err_len){
+
+  /*
+   * pg_open
+   * Maps a packed genome file and checks its header and contig table.
+   */
+
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0){
+    snprintf(err, err_len, "cannot open packed genome file %s", path);
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < 16){
+    close(fd);
+    snprintf(err, err_len, "%s is not a packed genome file", path);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid once the descriptor is closed.
+  close(fd);
+  if (map == MAP_FAILED){
+    snprintf(err, err_len, "cannot map packed genome file %s", path);
+    return NULL;
+  }
+
+  const unsigned char *base = (const unsigned char*) map;
+  uint32_t version, nc;
+  memcpy(&version, base + 8, sizeof(uint32_t));
+  memcpy(&nc, base + 12, sizeof(uint32_t));
+
+  int ok = memcmp(base, PG_MAGIC, 8) == 0 && version == PG_VERSION &&
+           16 + (uint64_t) nc * sizeof(PgContig) <= (uint64_t) st.st_size;
+  const PgContig *contigs = (const PgContig*) (base + 16);
+  for (uint32_t i = 0; ok && i < nc; i++){
+    ok = contigs[i].seq_offset + (contigs[i].length + 3)/4 <= (uint64_t) st.st_size &&
+         contigs[i].nrun_offset + contigs[i].nrun_count*sizeof(PgRun) <= (uint64_t) st.st_size &&
+         contigs[i].nrun_offset % 8 == 0;
+  }
+  if (!ok){
+    munmap(map, (size_t) st.st_size);
+    snprintf(err, err_len, "%s is not a valid packed genome file", path);
+    return NULL;
+  }
+
+  PackedGenome *pg = (PackedGenome*) malloc(sizeof(PackedGenome));
+  if (pg == NULL){
+    munmap(map, (size_t) st.st_size);
+    snprintf(err, err_len, "out of memory");
+    return NULL;
+  }
+  pg->map = map;
+  pg->map_len = (size_t) st.st_size;
+  pg->n_contig = nc;
+  pg->contigs = contigs;
+  return pg;
+}
+
+void pg_close(PackedGenome *pg){
+
+  if (pg == NULL) return;
+  munmap(pg->map, pg->map_len);
+  free(pg);
+}
+
+int pg_contig_index(const PackedGenome *pg, const char *name){
+
+  for (uint32_t i = 0; i < pg->n_contig; i++){
+    if (strncmp(pg->contigs[i].name, name, PG_NAME_LEN) == 0) return (int) i;
+  }
+  return -1;
+}
+
+static const PgRun *pg_runs(const PackedGenome *pg, int contig){
+  return (const PgRun*) ((const unsigned char*) pg->map + pg->contigs[contig].nrun_offset);
+}
+
+int pg_window_valid(const PackedGenome *pg, int contig, int64_t begin, int len){
+
+  /*
+   * pg_window_valid
+   * Binary search of the first n-run ending after begin.
+   */
+
+  if (contig < 0 || (uint32_t) contig >= pg->n_contig || begin < 0 || len < 0) return 0;
+  const PgContig *ctg = &pg->contigs[contig];
+  if ((uint64_t) begin + (uint64_t) len > ctg->length) return 0;
+
+  const PgRun *runs = pg_runs(pg, contig);
+  uint64_t lo = 0, hi = ctg->nrun_count;
+  while (lo < hi){
+    uint64_t mid = (lo + hi) / 2;
+    if (runs[mid].start + runs[mid].length <= (uint64_t) begin) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo == ctg->nrun_count || runs[lo].start >= (uint64_t) begin + (uint64_t) len;
+}
+
+int pg_fetch(const PackedGenome *pg, int contig, int64_t begin, int len, char *out){
+
+  /*
+   * pg_fetch
+   * Decodes a window of a contig, masking the bases inside n-runs.
+   */
+
+  if (contig < 0 || (uint32_t) contig >= pg->n_contig || begin < 0 || len < 0) return -1;
+  const PgContig *ctg = &pg->contigs[contig];
+  if ((uint64_t) begin + (uint64_t) len > ctg->length) return -1;
+
+  const unsigned char *seq = (const unsigned char*) pg->map + ctg->seq_offset;
+  uint64_t p = (uint64_t) begin;
+  for (int i = 0; i < len; i++, p++){
+    out[i] = pg_base_chr[(seq[p >> 2] >> (2*(p & 3))) & 3];
+  }
+  out[len] = '\0';
+
+  // First n-run ending after begin.
+  const PgRun *runs = pg_runs(pg, contig);
+  uint64_t lo = 0, hi = ctg->nrun_count, end = (uint64_t) begin + (uint64_t) len;
+  while (lo < hi){
+    uint64_t mid = (lo + hi) / 2;
+    if (runs[mid].start + runs[mid].length <= (uint64_t) begin) lo = mid + 1;
+    else hi = mid;
+  }
+  for (; lo < ctg->nrun_count && runs[lo].start < end; lo++){
+    uint64_t s = runs[lo].start > (uint64_t) begin ? runs[lo].start : (uint64_t) begin;
+    uint64_t e = runs[lo].start + runs[lo].length < end ? runs[lo].start + runs[lo].length : end;
+    memset(out + (s - (uint64_t) begin), 'n', (size_t) (e - s));
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef DMMD_GENOME_H
+#define DMMD_GENOME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packed genome store.
+ *
+ * Chromosomes are kept on disk with 2 bits per base so that the whole
+ * reference can be memory mapped and shared (page cache) by every process
+ * of the pipeline, instead of holding each chromosome as a lowercase R string.
+ *
+ * On-disk layout (host byte order, little-endian in practice):
+ *
+ *  header   : char magic[8] = "DMMD2BIT", uint32 version, uint32 nContig
+ *  contigs  : nContig x PgContig (64 bytes each)
+ *  sequence : per contig, ceil(length/4) bytes. Base k of a contig is kept in
+ *             bits 2*(k%4) of byte k/4, coded a=0, c=1, g=2, t=3.
+ *  n-runs   : per contig, nRunCount x PgRun, sorted by start. Any base that is
+ *             not a, c, g or t (case-insensitive) belongs to an n-run and is
+ *             stored as 'a' in the sequence section.
+ */
+
+#define PG_MAGIC "DMMD2BIT"
+#define PG_VERSION 1
+#define PG_NAME_LEN 32
+
+typedef struct {
+  char name[PG_NAME_LEN];
+  uint64_t length;
+  uint64_t seq_offset;
+  uint64_t nrun_offset;
+  uint64_t nrun_count;
+} PgContig;
+
+typedef struct {
+  uint64_t start;
+  uint64_t length;
+} PgRun;
+
+typedef struct {
+  void *map;
+  size_t map_len;
+  uint32_t n_contig;
+  const PgContig *contigs;
+} PackedGenome;
+
+/* Builds a packed genome file from one FASTA file per contig, plain or
+ * gzip/BGZF compressed (BGZF blocks are inflated on n_threads threads). Only
+ * the first record of each FASTA file is packed, as ReadFasta does. A FASTA
+ * file that cannot be opened gives an empty contig. Returns 0 on success. */
+int pg_build(const char *out_path, int n_contig, const char *const *names,
+             const char *const *fasta_paths, int n_threads, char *err, size_t err_len);
+
+/* Maps a packed genome file read-only. Returns NULL on failure. */
+PackedGenome *pg_open(const char *path, char *err, size_t err_len);
+void pg_close(PackedGenome *pg);
+
+/* Index of the contig called name, or -1. */
+int pg_contig_index(const PackedGenome *pg, const char *name);
+
+/* Decodes len bases of contig starting at begin (0-based) into out as
+ * lowercase a/c/g/t, with 'n' for bases inside n-runs. out must hold len+1
+ * chars; it is NUL terminated. Returns 0, or -1 if the window is out of range. */
+int pg_fetch(const PackedGenome *pg, int contig, int64_t begin, int len, char *out);
+
+/* 1 if the window is in range and overlaps no n-run, 0 otherwise. */
+int pg_window_valid(const PackedGenome *pg, int contig, int64_t begin, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
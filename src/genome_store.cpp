@@ -0,0 +1,126 @@
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "genome.h"
+#include "faidx.h"
+#include "fastaio.h"
+
+using namespace Rcpp;
+using namespace std;
+
+static void pg_xptr_finalize(PackedGenome* pg) {
+    pg_close(pg);
+}
+
+typedef XPtr<PackedGenome, PreserveStorage, pg_xptr_finalize, true> PackedGenomePtr;
+
+static void fai_xptr_finalize(FaiIndex* fai) {
+    fai_close(fai);
+}
+
+typedef XPtr<FaiIndex, PreserveStorage, fai_xptr_finalize, true> FaiIndexPtr;
+
+// Helper: contig names and fasta files, in the order used by ReadFasta_cpp
+static void genome_layout(List Config, vector<string>& names, vector<string>& paths) {
+    int NumAutosomes = as<int>(Config["NumAutosomes"]);
+    string DirFas = as<string>(Config["DirFas"]);
+    CharacterVector Allosomes = Config.containsElementNamed("Allosomes") && !Rf_isNull(Config["Allosomes"])
+        ? as<CharacterVector>(Config["Allosomes"]) : CharacterVector(0);
+
+    for (int i1 = 0; i1 < NumAutosomes; i1++) {
+        names.push_back("chr" + to_string(i1 + 1));
+    }
+    for (int i2 = 0; i2 < Allosomes.size(); i2++) {
+        names.push_back("chr" + as<string>(Allosomes[i2]));
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        // chrN.fa, or chrN.fa.gz if only the compressed file exists
+        string path = DirFas + "/" + names[i] + ".fa";
+        vector<char> resolved(path.size() + 4);
+        fa_path_resolve(path.c_str(), resolved.data(), resolved.size());
+        paths.push_back(string(resolved.data()));
+    }
+}
+
+// [[Rcpp::export]]
+void PackGenome_cpp(List Config, std::string PathOut) {
+    // Packs the chromosomes' fasta files of Config$DirFas (plain or gzip/BGZF
+    // compressed) into a 2-bit genome file
+    vector<string> names, paths;
+    genome_layout(Config, names, paths);
+    int nCPU = Config.containsElementNamed("nCPU") ? as<int>(Config["nCPU"]) : 1;
+
+    vector<const char*> cnames, cpaths;
+    for (size_t i = 0; i < names.size(); i++) {
+        cnames.push_back(names[i].c_str());
+        cpaths.push_back(paths[i].c_str());
+    }
+
+    char err[1024] = "";
+    int status = pg_build(PathOut.c_str(), (int) names.size(), cnames.data(), cpaths.data(), nCPU, err, sizeof(err));
+    if (status < 0) {
+        stop("PackGenome_cpp: %s", err);
+    }
+    if (status > 0) {
+        warning("PackGenome_cpp: %s", err);
+    }
+}
+
+// [[Rcpp::export]]
+List OpenGenome_cpp(std::string Path) {
+    // Maps a packed genome file. The mapping is released when the returned
+    // object is garbage collected.
+    char err[1024] = "";
+    PackedGenome* pg = pg_open(Path.c_str(), err, sizeof(err));
+    if (pg == NULL) {
+        stop("OpenGenome_cpp: %s", err);
+    }
+
+    CharacterVector ChrName(pg->n_contig);
+    NumericVector ChrLen(pg->n_contig);
+    for (uint32_t i = 0; i < pg->n_contig; i++) {
+        ChrName[i] = string(pg->contigs[i].name);
+        ChrLen[i] = (double) pg->contigs[i].length;
+    }
+
+    PackedGenomePtr ptr(pg, true, Rf_install("DMMD_PackedGenome"));
+    return List::create(
+        Named("Genome") = ptr,
+        Named("ChrName") = ChrName,
+        Named("ChrLen") = ChrLen
+    );
+}
+
+// [[Rcpp::export]]
+List OpenFastaIndex_cpp(List Config) {
+    // Opens the chromosomes' fasta files of Config$DirFas for windowed reads,
+    // building their .fai index if needed. Only the first record of each
+    // file is used, as in ReadFasta_cpp.
+    vector<string> names, paths;
+    genome_layout(Config, names, paths);
+
+    List Fasta(names.size());
+    CharacterVector ChrName(names.size());
+    NumericVector ChrLen(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        char err[1024] = "";
+        FaiIndex* fai = fai_load(paths[i].c_str(), err, sizeof(err));
+        if (fai == NULL) {
+            stop("OpenFastaIndex_cpp: %s", err);
+        }
+        FaiIndexPtr ptr(fai, true, Rf_install("DMMD_FastaIndex"));
+        if (fai->n_record == 0) {
+            stop("OpenFastaIndex_cpp: no sequence in %s", paths[i]);
+        }
+        Fasta[i] = ptr;
+        ChrName[i] = names[i];
+        ChrLen[i] = (double) fai->records[0].length;
+    }
+
+    return List::create(
+        Named("Fasta") = Fasta,
+        Named("ChrName") = ChrName,
+        Named("ChrLen") = ChrLen
+    );
+}
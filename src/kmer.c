@@ -0,0 +1,70 @@
+#include <string.h>
+#include "kmer.h"
+#include "revcomp.h"
+
+#define KMER_ROW 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4
+
+const unsigned char kmer_code[256] = {
+  KMER_ROW, KMER_ROW, KMER_ROW, KMER_ROW,
+  // 0x40: @ A B C D E F G H I J K L M N O
+  4,0,4,1,4,4,4,2,4,4,4,4,4,4,4,4,
+  // 0x50: P Q R S T U V W X Y Z [ \ ] ^ _
+  4,4,4,4,3,4,4,4,4,4,4,4,4,4,4,4,
+  // 0x60: ` a b c d e f g h i j k l m n o
+  4,0,4,1,4,4,4,2,4,4,4,4,4,4,4,4,
+  // 0x70: p q r s t u v w x y z { | } ~
+  4,4,4,4,3,4,4,4,4,4,4,4,4,4,4,4,
+  KMER_ROW, KMER_ROW, KMER_ROW, KMER_ROW,
+  KMER_ROW, KMER_ROW, KMER_ROW, KMER_ROW
+};
+
+static const char kmer_letter[4] = {'a', 'c', 'g', 't'};
+
+int kmer_pack(const char *s, int len, PackedKmer *k){
+
+  unsigned char bad = 0;
+
+  memset(k, 0, sizeof(*k));
+  if (len < 0 || len > KMER_MAX_LEN) return -1;
+  for (int i = 0; i < len; i++){
+    unsigned char c = kmer_code[(unsigned char) s[i]];
+    bad |= c;
+    k->w[i >> 5] |= (uint64_t) (c & 3) << (62 - 2*(i & 31));
+  }
+  // Only the invalid code has bit 2 set.
+  return (bad & 4) ? -1 : 0;
+}
+
+void kmer_unpack(const PackedKmer *k, int len, char *out){
+
+  for (int i = 0; i < len; i++) out[i] = kmer_letter[kmer_base(k, i)];
+  out[len] = '\0';
+}
+
+void kmer_revcomp(const PackedKmer *k, int len, PackedKmer *out){
+
+  PackedKmer r;
+  revcomp_packed(k->w, len, r.w);
+  *out = r;
+}
+
+void kmer_comp(const PackedKmer *k, int len, PackedKmer *out){
+
+  // a<->t and c<->g flip both bits of a base: flip the bits in use.
+  PackedKmer r = *k;
+  for (int j = 0; j < 3 && len > 32*j; j++){
+    int n = len - 32*j < 32 ? len - 32*j : 32;
+    r.w[j] ^= n == 32 ? ~0ULL : ~0ULL << (64 - 2*n);
+  }
+  *out = r;
+}
+
+void kmer_sub(const PackedKmer *k, int off, int len, PackedKmer *out){
+
+  PackedKmer r = {{0, 0, 0}};
+  for (int i = 0; i < len; i++){
+    uint64_t c = kmer_base(k, off + i);
+    r.w[i >> 5] |= c << (62 - 2*(i & 31));
+  }
+  *out = r;
+}
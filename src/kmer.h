@@ -0,0 +1,92 @@
+#ifndef DMMD_KMER_H
+#define DMMD_KMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packed words.
+ *
+ * A word of up to KMER_MAX_LEN bases (2*w+2 <= 72 for w <= 35) kept in
+ * three 64-bit integers with 2 bits per base, coded a=0, c=1, g=2, t=3 as
+ * in the packed genome. Base i lives in w[i/32], the first base of each
+ * integer in its most significant bits, and unused bits are zero. Words of
+ * the same length then compare as integers in the order of their strings,
+ * and compare equal with three integer compares instead of a string one.
+ * The length is not stored: all the words of a dictionary width share it.
+ *
+ * In R a column of packed words is a numeric matrix with one row per word
+ * and three columns holding the integers' bits (as bit64 does), with the
+ * word length as its "KmerLen" attribute.
+ */
+
+#define KMER_MAX_LEN 96
+
+typedef struct {
+  uint64_t w[3];
+} PackedKmer;
+
+/* Code of each byte: 0-3 for a, c, g, t (either case), 4 for the others. */
+extern const unsigned char kmer_code[256];
+
+/* Packs the len bases of s. Returns 0, or -1 if len is out of range or s
+ * has bases other than a, c, g or t. */
+int kmer_pack(const char *s, int len, PackedKmer *k);
+
+/* Writes the len bases of k to out, lowercase and NUL terminated. */
+void kmer_unpack(const PackedKmer *k, int len, char *out);
+
+/* Reverse complement of the len bases of k. */
+void kmer_revcomp(const PackedKmer *k, int len, PackedKmer *out);
+
+/* Complement of the len bases of k, in the same order. */
+void kmer_comp(const PackedKmer *k, int len, PackedKmer *out);
+
+/* The len bases of k starting at base off. */
+void kmer_sub(const PackedKmer *k, int off, int len, PackedKmer *out);
+
+static inline int kmer_base(const PackedKmer *k, int i){
+  return (int) ((k->w[i >> 5] >> (62 - 2*(i & 31))) & 3);
+}
+
+static inline int kmer_equal(const PackedKmer *a, const PackedKmer *b){
+  return a->w[0] == b->w[0] && a->w[1] == b->w[1] && a->w[2] == b->w[2];
+}
+
+/* <0, 0 or >0 as the strings of two words of the same length. */
+static inline int kmer_compare(const PackedKmer *a, const PackedKmer *b){
+  for (int i = 0; i < 3; i++){
+    if (a->w[i] != b->w[i]) return a->w[i] < b->w[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static inline uint64_t kmer_hash(const PackedKmer *k){
+  // Mix of the three integers (splitmix64 finalizer).
+  uint64_t h = k->w[0] ^ (k->w[1] * 0x9e3779b97f4a7c15ULL) ^ (k->w[2] * 0xc2b2ae3d27d4eb4fULL);
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+#ifdef __cplusplus
+}
+
+// Functors for the standard containers.
+struct PackedKmerHash {
+  size_t operator()(const PackedKmer& k) const { return (size_t) kmer_hash(&k); }
+};
+struct PackedKmerEqual {
+  bool operator()(const PackedKmer& a, const PackedKmer& b) const { return kmer_equal(&a, &b); }
+};
+struct PackedKmerLess {
+  bool operator()(const PackedKmer& a, const PackedKmer& b) const { return kmer_compare(&a, &b) < 0; }
+};
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nruns.h"
+
+#define NRUN_ROW 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1
+
+// 0 for a, c, g, t, A, C, G and T; 1 for every other byte.
+const unsigned char nrun_invalid_base[256] = {
+  NRUN_ROW, NRUN_ROW, NRUN_ROW, NRUN_ROW,
+  // 0x40: @ A B C D E F G H I J K L M N O
+  1,0,1,0,1,1,1,0,1,1,1,1,1,1,1,1,
+  // 0x50: P Q R S T U V W X Y Z [ \ ] ^ _
+  1,1,1,1,0,1,1,1,1,1,1,1,1,1,1,1,
+  // 0x60: ` a b c d e f g h i j k l m n o
+  1,0,1,0,1,1,1,0,1,1,1,1,1,1,1,1,
+  // 0x70: p q r s t u v w x y z { | } ~
+  1,1,1,1,0,1,1,1,1,1,1,1,1,1,1,1,
+  NRUN_ROW, NRUN_ROW, NRUN_ROW, NRUN_ROW,
+  NRUN_ROW, NRUN_ROW, NRUN_ROW, NRUN_ROW
+};
+
+int nrun_build(const char *seq, int64_t len, NRunIndex *idx){
+
+  /*
+   * nrun_build
+   * One pass over the sequence, collecting the runs of invalid bases.
+   */
+
+  int cap = 64, n = 0;
+  int *runs = (int*) malloc(2*cap*sizeof(int));
+  const unsigned char *s = (const unsigned char*) seq;
+  int64_t i = 0;
+
+  idx->start = idx->end = NULL;
+  idx->n = 0;
+  idx->owned = NULL;
+  if (runs == NULL) return -1;
+
+  while (i < len){
+    // Skip valid bases; runs of invalid ones are rare.
+    while (i < len && !nrun_invalid_base[s[i]]) i++;
+    if (i == len) break;
+    int64_t b = i;
+    while (i < len && nrun_invalid_base[s[i]]) i++;
+
+    if (n == cap){
+      int *grown = (int*) realloc(runs, 4*cap*sizeof(int));
+      if (grown == NULL){ free(runs); return -1; }
+      runs = grown;
+      cap *= 2;
+    }
+    runs[2*n] = (int) b;
+    runs[2*n+1] = (int) i;
+    n++;
+  }
+
+  // Split the interleaved pairs into starts and ends.
+  int *out = (int*) malloc((2*n > 0 ? 2*n : 1)*sizeof(int));
+  if (out == NULL){ free(runs); return -1; }
+  for (int k = 0; k < n; k++){
+    out[k] = runs[2*k];
+    out[n+k] = runs[2*k+1];
+  }
+  free(runs);
+
+  idx->start = out;
+  idx->end = out + n;
+  idx->n = n;
+  idx->owned = out;
+  return 0;
+}
+
+void nrun_borrow(NRunIndex *idx, const int *start, const int *end, int n){
+
+  idx->start = start;
+  idx->end = end;
+  idx->n = n;
+  idx->owned = NULL;
+}
+
+void nrun_free(NRunIndex *idx){
+
+  free(idx->owned);
+  idx->owned = NULL;
+  idx->start = idx->end = NULL;
+  idx->n = 0;
+}
+
+int nrun_window_valid(const NRunIndex *idx, int64_t begin, int len){
+
+  // First run ending after begin; the window is valid if it starts at or
+  // after the end of the window.
+  if (len <= 0) return 1;
+  int lo = 0, hi = idx->n;
+  while (lo < hi){
+    int mid = lo + (hi - lo) / 2;
+    if (idx->end[mid] <= begin) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo == idx->n || idx->start[lo] >= begin + len;
+}
+
+int nrun_seq_valid(const char *seq, int len){
+
+  // Branch free, so that it vectorizes.
+  unsigned char bad = 0;
+  for (int i = 0; i < len; i++) bad |= nrun_invalid_base[(unsigned char) seq[i]];
+  return !bad;
+}
@@ -0,0 +1,49 @@
+#ifndef DMMD_NRUNS_H
+#define DMMD_NRUNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Index of the invalid bases of a chromosome (anything but a, c, g or t,
+ * either case), as sorted, disjoint runs [start[i], end[i]). A window is
+ * valid when it overlaps no run, which is checked with one binary search
+ * instead of looking at each of its bases.
+ *
+ * In R the index is kept as the "NRuns" attribute of the chromosome
+ * sequence, an integer vector c(starts, ends).
+ */
+
+typedef struct {
+  const int *start;
+  const int *end;
+  int n;
+  int *owned;   // buffer to free, if the runs are not borrowed from R
+} NRunIndex;
+
+/* Nonzero for the bytes that are not a, c, g or t. */
+extern const unsigned char nrun_invalid_base[256];
+
+/* Builds the index of seq[0..len). Returns 0, or -1 if out of memory. */
+int nrun_build(const char *seq, int64_t len, NRunIndex *idx);
+
+/* Index over runs stored elsewhere (e.g. the "NRuns" attribute). */
+void nrun_borrow(NRunIndex *idx, const int *start, const int *end, int n);
+
+void nrun_free(NRunIndex *idx);
+
+/* 1 if [begin, begin+len) overlaps no run. */
+int nrun_window_valid(const NRunIndex *idx, int64_t begin, int len);
+
+/* 1 if the len bases of seq are a, c, g or t. */
+int nrun_seq_valid(const char *seq, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include <string.h>
+#include "revcomp.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define REVCOMP_X86 1
+#include <immintrin.h>
+#endif
+
+#define COMP_ROW(b) b,b+1,b+2,b+3,b+4,b+5,b+6,b+7,b+8,b+9,b+10,b+11,b+12,b+13,b+14,b+15
+
+static const unsigned char comp_table[256] = {
+  COMP_ROW(0x00), COMP_ROW(0x10), COMP_ROW(0x20), COMP_ROW(0x30),
+  // 0x40: @ A B C D E F G H I J K L M N O
+  '@','T','B','G','D','E','F','C','H','I','J','K','L','M','N','O',
+  // 0x50: P Q R S T U V W X Y Z [ \ ] ^ _
+  'P','Q','R','S','A','U','V','W','X','Y','Z','[','\\',']','^','_',
+  // 0x60: ` a b c d e f g h i j k l m n o
+  '`','t','b','g','d','e','f','c','h','i','j','k','l','m','n','o',
+  // 0x70: p q r s t u v w x y z { | } ~
+  'p','q','r','s','a','u','v','w','x','y','z','{','|','}','~',0x7f,
+  COMP_ROW(0x80), COMP_ROW(0x90), COMP_ROW(0xa0), COMP_ROW(0xb0),
+  COMP_ROW(0xc0), COMP_ROW(0xd0), COMP_ROW(0xe0), COMP_ROW(0xf0)
+};
+
+static void comp_scalar(const char *in, char *out, int len){
+
+  for (int i = 0; i < len; i++) out[i] = comp_table[(unsigned char) in[i]];
+}
+
+static void revcomp_scalar(const char *in, char *out, int len){
+
+  for (int i = 0; i < len; i++) out[len - 1 - i] = comp_table[(unsigned char) in[i]];
+}
+
+#ifdef REVCOMP_X86
+
+/*
+ * A byte x is a, c, g or t (either case) when x|0x20 is one of the
+ * lowercase letters. a and t differ by 0x15, c and g by 0x04, and neither
+ * touches the case bit, so the complement is x xor the matching mask.
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i comp_sse(__m128i x){
+
+  __m128i l = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  __m128i at = _mm_or_si128(_mm_cmpeq_epi8(l, _mm_set1_epi8('a')), _mm_cmpeq_epi8(l, _mm_set1_epi8('t')));
+  __m128i cg = _mm_or_si128(_mm_cmpeq_epi8(l, _mm_set1_epi8('c')), _mm_cmpeq_epi8(l, _mm_set1_epi8('g')));
+  __m128i d = _mm_or_si128(_mm_and_si128(at, _mm_set1_epi8(0x15)), _mm_and_si128(cg, _mm_set1_epi8(0x04)));
+  return _mm_xor_si128(x, d);
+}
+
+__attribute__((target("ssse3")))
+static void comp_ssse3(const char *in, char *out, int len){
+
+  int i = 0;
+  for (; i + 16 <= len; i += 16){
+    __m128i x = _mm_loadu_si128((const __m128i*) (in + i));
+    _mm_storeu_si128((__m128i*) (out + i), comp_sse(x));
+  }
+  comp_scalar(in + i, out + i, len - i);
+}
+
+__attribute__((target("ssse3")))
+static void revcomp_ssse3(const char *in, char *out, int len){
+
+  const __m128i rev = _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+  int i = 0;
+  for (; i + 16 <= len; i += 16){
+    __m128i x = _mm_loadu_si128((const __m128i*) (in + i));
+    _mm_storeu_si128((__m128i*) (out + len - i - 16), _mm_shuffle_epi8(comp_sse(x), rev));
+  }
+  // The first len-i bytes of out.
+  for (int k = i; k < len; k++) out[len - 1 - k] = comp_table[(unsigned char) in[k]];
+}
+
+__attribute__((target("avx2")))
+static inline __m256i comp_avx(__m256i x){
+
+  __m256i l = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+  __m256i at = _mm256_or_si256(_mm256_cmpeq_epi8(l, _mm256_set1_epi8('a')), _mm256_cmpeq_epi8(l, _mm256_set1_epi8('t')));
+  __m256i cg = _mm256_or_si256(_mm256_cmpeq_epi8(l, _mm256_set1_epi8('c')), _mm256_cmpeq_epi8(l, _mm256_set1_epi8('g')));
+  __m256i d = _mm256_or_si256(_mm256_and_si256(at, _mm256_set1_epi8(0x15)), _mm256_and_si256(cg, _mm256_set1_epi8(0x04)));
+  return _mm256_xor_si256(x, d);
+}
+
+__attribute__((target("avx2")))
+static void comp_avx2(const char *in, char *out, int len){
+
+  int i = 0;
+  for (; i + 32 <= len; i += 32){
+    __m256i x = _mm256_loadu_si256((const __m256i*) (in + i));
+    _mm256_storeu_si256((__m256i*) (out + i), comp_avx(x));
+  }
+  comp_ssse3(in + i, out + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void revcomp_avx2(const char *in, char *out, int len){
+
+  // Reverse the bytes of each 128-bit lane, then swap the lanes.
+  const __m256i rev = _mm256_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,
+                                       15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+  int i = 0;
+  for (; i + 32 <= len; i += 32){
+    __m256i x = _mm256_loadu_si256((const __m256i*) (in + i));
+    __m256i y = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(comp_avx(x), rev), 0x4e);
+    _mm256_storeu_si256((__m256i*) (out + len - i - 32), y);
+  }
+  revcomp_ssse3(in + i, out, len - i);
+}
+
+#endif
+
+typedef void (*comp_fn)(const char*, char*, int);
+
+// Table kernels until revcomp_init picks the fastest ones.
+static comp_fn comp_impl = comp_scalar, revcomp_impl = revcomp_scalar;
+
+int revcomp_select(int level){
+
+  if (level == REVCOMP_TABLE){
+    comp_impl = comp_scalar;
+    revcomp_impl = revcomp_scalar;
+    return 0;
+  }
+#ifdef REVCOMP_X86
+  __builtin_cpu_init();
+  if (level == REVCOMP_AVX2 && __builtin_cpu_supports("avx2")){
+    comp_impl = comp_avx2;
+    revcomp_impl = revcomp_avx2;
+    return 0;
+  }
+  if (level == REVCOMP_SSSE3 && __builtin_cpu_supports("ssse3")){
+    comp_impl = comp_ssse3;
+    revcomp_impl = revcomp_ssse3;
+    return 0;
+  }
+#endif
+  return -1;
+}
+
+void revcomp_init(void){
+
+  if (revcomp_select(REVCOMP_AVX2) != 0 && revcomp_select(REVCOMP_SSSE3) != 0){
+    revcomp_select(REVCOMP_TABLE);
+  }
+}
+
+void comp_ascii(const char *in, char *out, int len){
+
+  comp_impl(in, out, len);
+}
+
+void revcomp_ascii(const char *in, char *out, int len){
+
+  revcomp_impl(in, out, len);
+}
+
+static inline uint64_t reverse_pairs(uint64_t x){
+
+  // Reverses the order of the 32 2-bit groups of x.
+  x = __builtin_bswap64(x);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  return x;
+}
+
+void revcomp_packed(const uint64_t in[3], int len, uint64_t out[3]){
+
+  /*
+   * revcomp_packed
+   * Complements every base of the 96 base slots and reverses their order,
+   * which leaves base len-1-i at slot 96-len+i; the word is then shifted
+   * 96-len slots up, which also drops the complemented padding.
+   */
+
+  uint64_t r[3] = { reverse_pairs(~in[2]), reverse_pairs(~in[1]), reverse_pairs(~in[0]) };
+  int s = 2 * (96 - len), q = s / 64, b = s % 64;
+
+  for (int i = 0; i < 3; i++){
+    uint64_t hi = i + q < 3 ? r[i + q] : 0;
+    uint64_t lo = i + q + 1 < 3 ? r[i + q + 1] : 0;
+    out[i] = b == 0 ? hi : (hi << b) | (lo >> (64 - b));
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef DMMD_REVCOMP_H
+#define DMMD_REVCOMP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Complement and reverse complement of words, shared by SeqDic, Reverse,
+ * Rev_cpp, RevTot_cpp and the packed words of kmer.h.
+ *
+ * ASCII words: a, c, g and t are complemented keeping their case, any other
+ * byte (n, ...) is kept as is. On x86 the kernels use SSSE3 or AVX2
+ * shuffles when the processor has them (checked once, by revcomp_init,
+ * when the package is loaded), and a table otherwise.
+ *
+ * Packed words (three uint64, 2 bits per base, see kmer.h): the complement
+ * of a base is its code xor 3, so the reverse complement is a few bit
+ * operations per integer.
+ */
+
+/* Picks the kernels of the processor. Called once from R_init_DMMD, before
+ * any thread uses them; until then the table kernels are used. */
+void revcomp_init(void);
+
+/* Uses the kernels of one level instead, to test them. Returns 0, or -1 if
+ * the processor does not have it. */
+#define REVCOMP_TABLE 0
+#define REVCOMP_SSSE3 1
+#define REVCOMP_AVX2 2
+int revcomp_select(int level);
+
+/* Complement of the len bytes of in, to out (which may be in). */
+void comp_ascii(const char *in, char *out, int len);
+
+/* Reverse complement of the len bytes of in, to out. in and out must not
+ * overlap. */
+void revcomp_ascii(const char *in, char *out, int len);
+
+/* Reverse complement of a packed word of len <= 96 bases. */
+void revcomp_packed(const uint64_t in[3], int len, uint64_t out[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
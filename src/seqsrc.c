@@ -0,0 +1,110 @@
+#include <string.h>
+#include "seqsrc.h"
+#include "revcomp.h"
+
+int seq_src_init(SeqSrc *src, SEXP SeqChr, double *MaxLen){
+
+  src->seq = NULL;
+  src->pg = NULL;
+  src->contig = -1;
+  src->use_fai = 0;
+  nrun_borrow(&src->nruns, NULL, NULL, 0);
+
+  if (TYPEOF(SeqChr) == VECSXP && length(SeqChr) == 2 &&
+      TYPEOF(VECTOR_ELT(SeqChr, 0)) == EXTPTRSXP){
+    SEXP ptr = VECTOR_ELT(SeqChr, 0);
+    int contig = asInteger(VECTOR_ELT(SeqChr, 1)) - 1;
+    if (R_ExternalPtrAddr(ptr) == NULL) return -1;
+
+    if (R_ExternalPtrTag(ptr) == install("DMMD_PackedGenome")){
+      src->pg = (const PackedGenome*) R_ExternalPtrAddr(ptr);
+      if (contig < 0 || (uint32_t) contig >= src->pg->n_contig) return -1;
+      src->contig = contig;
+      *MaxLen = (double) src->pg->contigs[contig].length;
+      return 0;
+    }
+    if (R_ExternalPtrTag(ptr) == install("DMMD_FastaIndex")){
+      const FaiIndex *fai = (const FaiIndex*) R_ExternalPtrAddr(ptr);
+      if (contig < 0 || contig >= fai->n_record) return -1;
+      src->contig = contig;
+      src->use_fai = 1;
+      fai_reader_init(&src->fai, fai, contig);
+      *MaxLen = (double) fai->records[contig].length;
+      return 0;
+    }
+    return -1;
+  }
+
+  src->seq = CHAR(STRING_ELT(SeqChr, 0));
+
+  // Index built by ReadFasta_cpp, or built here for other strings.
+  SEXP NRuns = getAttrib(SeqChr, install("NRuns"));
+  if (TYPEOF(NRuns) == INTSXP && length(NRuns) % 2 == 0){
+    int n = length(NRuns) / 2;
+    nrun_borrow(&src->nruns, INTEGER(NRuns), INTEGER(NRuns) + n, n);
+    return 0;
+  }
+  return nrun_build(src->seq, LENGTH(STRING_ELT(SeqChr, 0)), &src->nruns);
+}
+
+int seq_src_window(SeqSrc *src, int begin, int Len, char *SubSeq){
+
+  /*
+   * seq_src_window
+   * Copies the window to SubSeq if it only has a, c, g or t bases.
+   * Returns 1 if it does, 0 otherwise. The window has already been
+   * checked against the chromosome length.
+   */
+
+  if (src->pg != NULL){
+    if (!pg_window_valid(src->pg, src->contig, begin, Len)) return 0;
+    pg_fetch(src->pg, src->contig, begin, Len, SubSeq);
+    return 1;
+  }
+  if (src->use_fai){
+    // Indexed fasta files have no n-run index: check the bases read.
+    return fai_reader_fetch(&src->fai, begin, Len, SubSeq) == 0 && nrun_seq_valid(SubSeq, Len);
+  }
+  if (!nrun_window_valid(&src->nruns, begin, Len)) return 0;
+  memcpy(SubSeq, src->seq+begin, Len);
+  SubSeq[Len] = '\0';
+  return 1;
+}
+
+void seq_src_free(SeqSrc *src){
+
+  if (src->use_fai) fai_reader_free(&src->fai);
+  nrun_free(&src->nruns);
+}
+
+void seq_src_copy(const SeqSrc *src, SeqSrc *copy){
+
+  *copy = *src;
+  // The n-run index stays with src.
+  copy->nruns.owned = NULL;
+  if (src->use_fai) fai_reader_init(&copy->fai, src->fai.fai, src->fai.rid);
+}
+
+int seq_dic_windows(SeqSrc *src, int MaxLen, char TargetMode, int Xcg, int x, int wMin, int wMax, int comp, char *Win){
+
+  int LenW = 2*wMax + 2;
+  int beginW = seq_dic_begin(TargetMode, Xcg, x, wMax);
+  int v = 0;
+
+  if (beginW >= 0 && beginW + LenW <= MaxLen && seq_src_window(src, beginW, LenW, Win)){
+    v = wMax - wMin + 1;
+  } else {
+    // Each width in its place of the widest window.
+    for (int w = wMin; w <= wMax; w++){
+      int begin = seq_dic_begin(TargetMode, Xcg, x, w), Len = 2*w + 2;
+      if (begin < 0 || begin + Len > MaxLen || !seq_src_window(src, begin, Len, Win + (begin - beginW))) break;
+      v++;
+    }
+  }
+  if (v > 0 && comp){
+    int w = wMin + v - 1;
+    char *top = Win + seq_dic_offset(TargetMode, w, wMax);
+    comp_ascii(top, top, 2*w + 2);
+  }
+  return v;
+}
@@ -0,0 +1,78 @@
+#ifndef DMMD_SEQSRC_H
+#define DMMD_SEQSRC_H
+
+#include <R.h>
+#include <Rinternals.h>
+#include "genome.h"
+#include "faidx.h"
+#include "nruns.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Source of the windows extracted by SeqDic: the sequence of the chromosome
+ * as an R string, a contig of a packed genome (see genome.h) given as
+ * list(<packed genome>, <contig number>), or a record of an indexed fasta
+ * file (see faidx.h) given as list(<fasta index>, <record number>).
+ * Windows with bases other than a, c, g or t are rejected through the n-run
+ * index of the source (see nruns.h), without looking at their bases.
+ */
+typedef struct {
+  const char *seq;
+  const PackedGenome *pg;
+  int contig;
+  int use_fai;
+  FaiReader fai;
+  NRunIndex nruns;
+} SeqSrc;
+
+/* Sets up src for SeqChr. *MaxLen is set to the length of packed genome
+ * and fasta index sources, and left as is for strings. Returns 0, or -1 if
+ * SeqChr is not a valid source. Uses the R API: call it from the main
+ * thread. */
+int seq_src_init(SeqSrc *src, SEXP SeqChr, double *MaxLen);
+
+/* Copies the Len bases at begin to SubSeq (NUL terminated) if they are all
+ * a, c, g or t. Returns 1 if they are, 0 otherwise. Sources of fasta
+ * indexes keep a read buffer, so a thread needs its own copy of them (see
+ * seq_src_copy). */
+int seq_src_window(SeqSrc *src, int begin, int Len, char *SubSeq);
+
+/* Copy of src for another thread, to be released with seq_src_free. */
+void seq_src_copy(const SeqSrc *src, SeqSrc *copy);
+
+void seq_src_free(SeqSrc *src);
+
+/* Start of the window of width w of the target at Xcg, for each growing
+ * mode (C, L or R). */
+static inline int seq_dic_begin(char TargetMode, int Xcg, int x, int w){
+  if (TargetMode == 'C') return Xcg + x - w - 1;
+  if (TargetMode == 'L') return Xcg + x - 2*w - 1;
+  return Xcg + x - 1;
+}
+
+/* Offset of the window of width w in the window of width W >= w of the
+ * same target: windows of a target nest for each growing mode. */
+static inline int seq_dic_offset(char TargetMode, int w, int W){
+  if (TargetMode == 'C') return W - w;
+  if (TargetMode == 'L') return 2*(W - w);
+  return 0;
+}
+
+/* Windows of every width from wMin to wMax of the target at Xcg, read once
+ * into Win (2*wMax+3 bytes): the window of width w starts at
+ * Win + seq_dic_offset(TargetMode, w, wMax). If the widest window is out of
+ * the chromosome (of length MaxLen) or has bases other than a, c, g or t,
+ * the widths are read on their own from the narrowest. With comp, the
+ * widest valid window is complemented (sense 0 of SeqDic). Returns the
+ * number of valid widths from wMin; the narrower windows of a valid one are
+ * valid too. */
+int seq_dic_windows(SeqSrc *src, int MaxLen, char TargetMode, int Xcg, int x, int wMin, int wMax, int comp, char *Win);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
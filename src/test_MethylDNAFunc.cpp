@@ -2,6 +2,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include "revcomp.h"
 
 extern "C" {
 #include <Rembedded.h>
@@ -23,6 +24,20 @@ List DelGaps_cpp(List Config, List SeqMetFreW);
 List DelGapsTot_cpp(List Config, List Seqs);
 List ProneMet_cpp(List Config, List SeqMetFreW);
 List ResisMet_cpp(List Config, List SeqMetFreW);
+NumericMatrix PackWords_cpp(CharacterVector Seq, int Len);
+CharacterVector UnpackWords_cpp(NumericMatrix Kmer);
+NumericMatrix RevPackedWords_cpp(NumericMatrix Kmer);
+List PartitionMet_cpp(List Config, List SeqMetFreW, bool Neutral, bool Gaps);
+IntegerVector TopK_cpp(NumericVector Freq, int K);
+List Fusion_cpp(List Config, List SeqMetFreW, List FreVecW);
+List find_strings_seq(StringVector in_str, StringVector out_str);
+List find_strings_hash(StringVector in_str, StringVector out_str, int num_cpu);
+List DicWord_cpp(List Config, List CooMet, List SeqChr, std::string Sense);
+List DicWordCanonical_cpp(List Config, List CooMetFor, List CooMetRev, List SeqChr);
+List ReadBedMethyl_cpp(List Config, std::string Path);
+List MergeBedMethyl_cpp(List Config, CharacterVector Paths, bool Weighted, int MinDepth);
+List ReadPB3Seq_cpp(List Config, std::string Dir);
+extern "C" SEXP SeqDic(SEXP CooMet, SEXP LenDic, SEXP nrow, SEXP SeqChr, SEXP LenChr, SEXP TargetGrowMode, SEXP X, SEXP sense);
 
 // Helper: run arbitrary R code in the embedded interpreter
 void run_R_code(const char* code) {
@@ -189,6 +204,275 @@ List call_ResisMet_R(List Config, List SeqMetFreW) {
     return ResisMet(Config, SeqMetFreW);
 }
 
+// Helper: an R function of the DMMD namespace, or of the global
+// environment when the namespace is not loaded
+Function get_DMMD_function(const char* name) {
+    try {
+        Environment dmmd = Environment::namespace_env("DMMD");
+        if (dmmd.exists(name)) {
+            return dmmd[name];
+        }
+    } catch (...) {}
+    Environment global = Environment::global_env();
+    if (!global.exists(name)) {
+        stop("%s not found in DMMD namespace or global environment", name);
+    }
+    return global[name];
+}
+
+// Helper: Fusion of all the widths with the R FuseSeq function, cutting the
+// inner words and dropping the fused ones as Fusion does
+List call_FuseSeq_R(List Config, List SeqMetFreW) {
+    run_R_code(
+        "FuseSeqAll <- function(Config, SeqMetFreW) {\n"
+        "  FuseSeq <- tryCatch(get('FuseSeq', envir = asNamespace('DMMD')), error = function(e) get('FuseSeq'))\n"
+        "  Start <- switch(Config$GrowingMode, C = 2, L = 3, R = 1)\n"
+        "  S <- list()\n"
+        "  for (w in Config$w_min:Config$w_max) {\n"
+        "    D <- SeqMetFreW[[w]]\n"
+        "    S[[w]] <- list(D[, 1], D[, 2], D[, 3], D[, 4], matrix(D[, 3], nrow(D), 2*w+2))\n"
+        "  }\n"
+        "  for (w in Config$w_min:(Config$w_max-1)) {\n"
+        "    Cut <- substring(S[[w+1]][[1]], Start, Start+2*w+1)\n"
+        "    IndFou <- lapply(S[[w]][[1]], function(x) which(Cut == x))\n"
+        "    IndFoUpd <- which(lengths(IndFou) > 0)\n"
+        "    Fus <- do.call(FuseSeq, c(list(Config), S[[w]], S[[w+1]], list(IndFou, IndFoUpd)))\n"
+        "    S[[w+1]] <- Fus[6:10]\n"
+        "    Keep <- lengths(IndFou) == 0\n"
+        "    S[[w]] <- list(S[[w]][[1]][Keep], S[[w]][[2]][Keep], S[[w]][[3]][Keep], S[[w]][[4]][Keep], S[[w]][[5]][Keep, , drop = FALSE])\n"
+        "  }\n"
+        "  lapply(S, function(x) if (is.null(x)) NULL else data.frame(SeqW = x[[1]], MetW = x[[2]], FreW = x[[3]], IndW = x[[4]], x[[5]]))\n"
+        "}\n");
+    Function FuseSeqAll = Environment::global_env()["FuseSeqAll"];
+    return FuseSeqAll(Config, SeqMetFreW);
+}
+
+// Helper: Read a bedMethyl file as the R reader did before ReadBedMethyl_cpp,
+// with fread, on its data lines (the track line is left out). The filters
+// of Config (see SignalFilter) are applied to the data frame
+List call_ReadBedMethyl_R(List Config, std::string Path) {
+    run_R_code(
+        "ReadBedMethylBaseline <- function(Config, Path) {\n"
+        "  Lines <- grep('^chr', readLines(gzfile(Path)), value = TRUE)\n"
+        "  df <- data.table::fread(text = Lines, colClasses = c('character', 'numeric', 'NULL', 'NULL', 'NULL', 'character', 'NULL', 'NULL', 'NULL', 'numeric', 'numeric'))\n"
+        "  df <- data.frame(ChrName = df[[1]], ColCoo = df[[2]], Sense = df[[3]], Cov = df[[4]], ColMet = df[[5]]/100)\n"
+        "  if (!is.null(Config$MinCoverage)) df <- df[df$Cov >= Config$MinCoverage, ]\n"
+        "  if (!is.null(Config$MetRange)) df <- df[df$ColMet >= Config$MetRange[1] & df$ColMet <= Config$MetRange[2], ]\n"
+        "  if (!is.null(Config$SignalRegions)) {\n"
+        "    Reg <- read.table(Config$SignalRegions, colClasses = c('character', 'numeric', 'numeric'))\n"
+        "    In <- vapply(seq_len(nrow(df)), function(i) any(Reg[[1]] == df$ChrName[i] & Reg[[2]] <= df$ColCoo[i] & df$ColCoo[i] < Reg[[3]]), logical(1))\n"
+        "    df <- df[In, ]\n"
+        "  }\n"
+        "  ChrNam <- paste0('chr', c(seq_len(Config$NumAutosomes), Config$Allosomes))\n"
+        "  Keep <- if (is.null(Config$SignalChromosomes)) ChrNam else Config$SignalChromosomes\n"
+        "  Split <- function(Sense) lapply(ChrNam, function(Chr) df[df$ChrName == Chr & Chr %in% Keep & df$Sense == Sense, c('ColCoo', 'ColMet')])\n"
+        "  list(Split('+'), Split('-'))\n"
+        "}\n");
+    Function ReadBedMethylBaseline = Environment::global_env()["ReadBedMethylBaseline"];
+    return ReadBedMethylBaseline(Config, Path);
+}
+
+// Helper: Merge bedMethyl replicates as the R code did before
+// MergeBedMethyl_cpp, with fread and rbindlist, averaging each coordinate
+// (weighted by coverage if Weighted) and dropping those whose pooled
+// coverage is below MinDepth
+List call_MergeBedMethyl_R(List Config, CharacterVector Paths, bool Weighted, int MinDepth) {
+    run_R_code(
+        "MergeBedMethylBaseline <- function(Config, Paths, Weighted, MinDepth) {\n"
+        "  Dfs <- lapply(Paths, function(Path) {\n"
+        "    df <- data.table::fread(Path, colClasses = c('character', 'numeric', 'NULL', 'NULL', 'NULL', 'character', 'NULL', 'NULL', 'NULL', 'numeric', 'numeric'))\n"
+        "    data.table::data.table(ChrName = df[[1]], ColCoo = df[[2]], Str = df[[3]], Cov = df[[4]], ColMet = df[[5]]/100)\n"
+        "  })\n"
+        "  ChrNam <- paste0('chr', c(seq_len(Config$NumAutosomes), Config$Allosomes))\n"
+        "  Pool <- function(Sense) lapply(ChrNam, function(Chr) {\n"
+        "    D <- data.table::rbindlist(lapply(Dfs, function(df) df[df$ChrName == Chr & df$Str == Sense, ]))\n"
+        "    if (nrow(D) == 0) return(data.frame(ColCoo = numeric(0), ColMet = numeric(0)))\n"
+        "    D$W <- if (Weighted) D$Cov else 1\n"
+        "    M <- as.data.frame(D[, list(ColMet = sum(W * ColMet) / sum(W), Depth = sum(Cov)), by = ColCoo])\n"
+        "    M <- M[M$Depth >= MinDepth, ]\n"
+        "    M[order(M$ColCoo), c('ColCoo', 'ColMet')]\n"
+        "  })\n"
+        "  list(Pool('+'), Pool('-'))\n"
+        "}\n");
+    Function MergeBedMethylBaseline = Environment::global_env()["MergeBedMethylBaseline"];
+    return MergeBedMethylBaseline(Config, Paths, Weighted, MinDepth);
+}
+
+// Helper: Read the PB3Seq call files as the R code did before
+// ReadPB3Seq_cpp, with read.table, but with the reverse file of the
+// allosomes (the old code read their forward file twice)
+List call_ReadPB3Seq_R(List Config, std::string Dir) {
+    run_R_code(
+        "ReadPB3SeqBaseline <- function(Config, Dir) {\n"
+        "  Read <- function(Chr, Sense) {\n"
+        "    Path <- file.path(Dir, paste0('chr', Chr, '.fa.txt_', Sense, '.txt_', Config$MotifTarget))\n"
+        "    df <- read.table(Path, colClasses = c('NULL', 'numeric', 'NULL', 'NULL', 'NULL', 'NULL', 'numeric', 'NULL'))\n"
+        "    colnames(df) <- c('ColCoo', 'ColMet')\n"
+        "    df\n"
+        "  }\n"
+        "  Chrs <- c(seq_len(Config$NumAutosomes), Config$Allosomes)\n"
+        "  list(lapply(Chrs, Read, 'forw'), lapply(Chrs, Read, 'rev'))\n"
+        "}\n");
+    Function ReadPB3SeqBaseline = Environment::global_env()["ReadPB3SeqBaseline"];
+    return ReadPB3SeqBaseline(Config, Dir);
+}
+
+// Helper: ReadPB3Seq_cpp on a copy of Dir where a malformed line has been
+// added to the forward file of chr1, with the warnings it gives
+List call_ReadPB3Seq_malformed(List Config, std::string Dir) {
+    run_R_code(
+        "ReadPB3SeqMalformed <- function(Read, Config, Dir) {\n"
+        "  Tmp <- tempfile('pb3seq')\n"
+        "  dir.create(Tmp)\n"
+        "  file.copy(list.files(Dir, full.names = TRUE), Tmp)\n"
+        "  cat('chr1 99 C CG\\n', file = file.path(Tmp, paste0('chr1.fa.txt_forw.txt_', Config$MotifTarget)), append = TRUE)\n"
+        "  Warnings <- character(0)\n"
+        "  CooMet <- withCallingHandlers(Read(Config, Tmp), warning = function(w) {\n"
+        "    Warnings <<- c(Warnings, conditionMessage(w))\n"
+        "    invokeRestart('muffleWarning')\n"
+        "  })\n"
+        "  unlink(Tmp, recursive = TRUE)\n"
+        "  list(CooMet = CooMet, Warnings = Warnings)\n"
+        "}\n");
+    Function ReadPB3SeqMalformed = Environment::global_env()["ReadPB3SeqMalformed"];
+    return ReadPB3SeqMalformed(get_DMMD_function("ReadPB3Seq_cpp"), Config, Dir);
+}
+
+// Helper: Copy of a fixture directory in a new temporary directory, so that
+// the indexes and caches written by the tests stay out of the source tree
+std::string copy_test_dir(const char* Dir) {
+    run_R_code(
+        "CopyTestDir <- function(Dir) {\n"
+        "  Tmp <- tempfile(basename(Dir))\n"
+        "  dir.create(Tmp)\n"
+        "  file.copy(list.files(Dir, full.names = TRUE), Tmp)\n"
+        "  Tmp\n"
+        "}\n");
+    Function CopyTestDir = Environment::global_env()["CopyTestDir"];
+    return as<std::string>(CopyTestDir(Dir));
+}
+
+// Helper: Damage a compressed file, cutting its last bytes ("truncate") or
+// flipping a byte in the middle of it ("corrupt")
+void damage_file(std::string Path, std::string Mode) {
+    run_R_code(
+        "DamageFile <- function(Path, Mode) {\n"
+        "  B <- readBin(Path, 'raw', file.size(Path))\n"
+        "  if (Mode == 'truncate') {\n"
+        "    B <- B[1:(length(B) - 30)]\n"
+        "  } else {\n"
+        "    i <- length(B) %/% 2\n"
+        "    B[i] <- xor(B[i], as.raw(255))\n"
+        "  }\n"
+        "  writeBin(B, Path)\n"
+        "}\n");
+    Function DamageFile = Environment::global_env()["DamageFile"];
+    DamageFile(Path, Mode);
+}
+
+// Helper: GenomeCache(Config), with whether it built the image
+List call_GenomeCache(List Config) {
+    run_R_code(
+        "GenomeCacheBuilt <- function(Config) {\n"
+        "  GenomeCache <- tryCatch(get('GenomeCache', envir = asNamespace('DMMD')), error = function(e) get('GenomeCache'))\n"
+        "  Out <- capture.output(SeqChr <- GenomeCache(Config))\n"
+        "  list(SeqChr = SeqChr, Built = any(grepl('Building genome cache', Out)))\n"
+        "}\n");
+    Function GenomeCacheBuilt = Environment::global_env()["GenomeCacheBuilt"];
+    return GenomeCacheBuilt(Config);
+}
+
+// Helper: Complement the bases of the chromosome 1 fasta file of Dir, which
+// keeps its size, and set its modification time to the current one plus
+// Shift seconds, or keep it if Shift is NA
+void change_test_fasta(std::string Dir, double Shift) {
+    run_R_code(
+        "ChangeTestFasta <- function(Dir, Shift) {\n"
+        "  Path <- file.path(Dir, 'chr1.fa')\n"
+        "  Old <- file.info(Path)$mtime\n"
+        "  Lines <- readLines(Path)\n"
+        "  Seq <- !startsWith(Lines, '>')\n"
+        "  Lines[Seq] <- chartr('acgtACGT', 'tgcaTGCA', Lines[Seq])\n"
+        "  writeLines(Lines, Path)\n"
+        "  Sys.setFileTime(Path, if (is.na(Shift)) Old else Sys.time() + Shift)\n"
+        "}\n");
+    Function ChangeTestFasta = Environment::global_env()["ChangeTestFasta"];
+    ChangeTestFasta(Dir, Shift);
+}
+
+// Helper: Runs of bases other than a, c, g or t of a chromosome string, as
+// the NRuns attribute holds them: c(starts, ends), 0-based and end excluded
+IntegerVector call_NRuns_R(std::string Seq) {
+    run_R_code(
+        "NRunsBaseline <- function(Seq) {\n"
+        "  m <- gregexpr('[^acgtACGT]+', Seq)[[1]]\n"
+        "  if (m[1] == -1) return(integer(0))\n"
+        "  Start <- as.integer(m) - 1L\n"
+        "  c(Start, Start + attr(m, 'match.length'))\n"
+        "}\n");
+    Function NRunsBaseline = Environment::global_env()["NRunsBaseline"];
+    return NRunsBaseline(Seq);
+}
+
+// Helper: The words SeqDic extracted from the chromosome string before the
+// packed genome, fasta index and n-run sources: "no" for the windows out of
+// the chromosome or with bases other than a, c, g or t, and complemented for
+// sense 0
+CharacterVector call_SeqDic_R(std::string Seq, NumericVector Coo, int w, std::string Mode, int X, int Sense) {
+    run_R_code(
+        "SeqDicBaseline <- function(Seq, Coo, w, Mode, X, Sense) {\n"
+        "  Len <- 2*w + 2\n"
+        "  Begin <- switch(Mode, C = Coo + X - w - 1, L = Coo + X - 2*w - 1, R = Coo + X - 1)\n"
+        "  Words <- substring(Seq, Begin + 1, Begin + Len)\n"
+        "  Ok <- Begin >= 0 & Begin + Len <= nchar(Seq) & grepl('^[acgt]+$', Words)\n"
+        "  if (Sense == 0) Words <- chartr('acgt', 'tgca', Words)\n"
+        "  Words[!Ok] <- 'no'\n"
+        "  Words\n"
+        "}\n");
+    Function SeqDicBaseline = Environment::global_env()["SeqDicBaseline"];
+    return SeqDicBaseline(Seq, Coo, w, Mode, X, Sense);
+}
+
+// Helper: Word dictionaries of one strand computed in R, as DicWord did
+// before DicWord_cpp: the windows of every target cut with substring
+// (complemented for "rev"), without those out of the chromosome, with bases
+// other than a, c, g or t or with NA methylation; Freq, mean Methyl and
+// first Index of each word, listed by Index, and the words of the prone and
+// resistant targets
+List call_DicWord_R(List Config, List CooMet, List SeqChr, std::string Sense) {
+    run_R_code(
+        "DicWordBaseline <- function(Config, CooMet, SeqChr, Sense) {\n"
+        "  SeqMetFreW <- list(); SeqPrn <- list(); SeqRes <- list()\n"
+        "  for (w in Config$w_min:Config$w_max) {\n"
+        "    Len <- 2*w + 2\n"
+        "    Words <- character(0); Met <- numeric(0); Ord <- integer(0); n <- 0\n"
+        "    for (c in seq_along(CooMet)) {\n"
+        "      Seq <- SeqChr[[c]]; Coo <- CooMet[[c]]$ColCoo; M <- CooMet[[c]]$ColMet\n"
+        "      Begin <- switch(Config$GrowingMode, C = Coo + Config$X - w - 1, L = Coo + Config$X - 2*w - 1, R = Coo + Config$X - 1)\n"
+        "      W <- substring(Seq, Begin + 1, Begin + Len)\n"
+        "      if (Sense == 'rev') W <- chartr('acgt', 'tgca', W)\n"
+        "      Ok <- Begin >= 0 & Begin + Len <= nchar(Seq) & grepl('^[acgt]+$', W) & !is.na(M)\n"
+        "      Words <- c(Words, W[Ok]); Met <- c(Met, M[Ok]); Ord <- c(Ord, n + which(Ok))\n"
+        "      n <- n + length(Coo)\n"
+        "    }\n"
+        "    D <- data.frame(Seq = character(0), Methyl = numeric(0), Freq = integer(0), Index = integer(0))\n"
+        "    if (length(Words) > 0) {\n"
+        "      Freq <- tapply(Met, Words, length)\n"
+        "      D <- data.frame(Seq = names(Freq), Methyl = as.vector(tapply(Met, Words, mean)),\n"
+        "                      Freq = as.vector(Freq), Index = as.vector(tapply(Ord, Words, min)), stringsAsFactors = FALSE)\n"
+        "      D <- D[D$Freq >= Config$ThrFre, ]\n"
+        "      D <- D[order(D$Index), ]\n"
+        "    }\n"
+        "    SeqMetFreW[[w]] <- D\n"
+        "    SeqPrn[[w]] <- Words[Met >= Config$MethProne]\n"
+        "    SeqRes[[w]] <- Words[Met <= Config$MethResis]\n"
+        "  }\n"
+        "  list(SeqMetFreW = SeqMetFreW, SeqTot = list(SeqPrn = SeqPrn, SeqRes = SeqRes))\n"
+        "}\n");
+    Function DicWordBaseline = Environment::global_env()["DicWordBaseline"];
+    return DicWordBaseline(Config, CooMet, SeqChr, Sense);
+}
+
 // Helper: Compare two lists of CharacterVectors
 bool compare_seq_lists(const List& a, const List& b) {
     if (a.size() != b.size()) return false;
@@ -336,6 +620,153 @@ bool compare_resismet_lists(const List& a, const List& b) {
     return true;
 }
 
+// Helper: Compare two Fusion result lists column by column, the
+// methylation up to rounding
+bool compare_fusion_lists(const List& a, const List& b, int w_min, int w_max) {
+    for (int w = w_min; w <= w_max; ++w) {
+        if (w > a.size() || w > b.size()) return false;
+        List dfA = a[w - 1];
+        List dfB = b[w - 1];
+        if (dfA.size() != dfB.size() || dfA.size() != 4 + 2*w + 2) return false;
+        CharacterVector seqA = dfA[0];
+        CharacterVector seqB = dfB[0];
+        if (seqA.size() != seqB.size()) return false;
+        for (int j = 0; j < seqA.size(); ++j) {
+            if (as<string>(seqA[j]) != as<string>(seqB[j])) return false;
+        }
+        NumericVector metA = dfA[1];
+        NumericVector metB = dfB[1];
+        for (int j = 0; j < metA.size(); ++j) {
+            if (std::abs(metA[j] - metB[j]) > 1e-9) return false;
+        }
+        for (int k = 2; k < dfA.size(); ++k) {
+            IntegerVector colA = as<IntegerVector>(dfA[k]);
+            IntegerVector colB = as<IntegerVector>(dfB[k]);
+            for (int j = 0; j < colA.size(); ++j) {
+                if (colA[j] != colB[j]) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Helper: Compare two DicWord results (SeqMetFreW and SeqTot), the
+// methylation up to rounding
+bool compare_dicword_results(const List& a, const List& b, int w_min, int w_max) {
+    List freA = a["SeqMetFreW"], freB = b["SeqMetFreW"];
+    List totA = a["SeqTot"], totB = b["SeqTot"];
+    for (int w = w_min; w <= w_max; ++w) {
+        DataFrame dfA = as<DataFrame>(freA[w - 1]);
+        DataFrame dfB = as<DataFrame>(freB[w - 1]);
+        if (dfA.nrows() != dfB.nrows()) return false;
+        CharacterVector seqA = dfA["Seq"], seqB = dfB["Seq"];
+        NumericVector metA = dfA["Methyl"], metB = dfB["Methyl"];
+        IntegerVector freqA = dfA["Freq"], freqB = dfB["Freq"];
+        IntegerVector indA = dfA["Index"], indB = dfB["Index"];
+        for (int j = 0; j < seqA.size(); ++j) {
+            if (as<string>(seqA[j]) != as<string>(seqB[j])) return false;
+            if (std::abs(metA[j] - metB[j]) > 1e-9) return false;
+            if (freqA[j] != freqB[j] || indA[j] != indB[j]) return false;
+        }
+        const char* sets[] = {"SeqPrn", "SeqRes"};
+        for (int k = 0; k < 2; ++k) {
+            CharacterVector vA = as<List>(totA[sets[k]])[w - 1];
+            CharacterVector vB = as<List>(totB[sets[k]])[w - 1];
+            if (vA.size() != vB.size()) return false;
+            for (int j = 0; j < vA.size(); ++j) {
+                if (as<string>(vA[j]) != as<string>(vB[j])) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Helper: Compare two CooMet structures, list(CooMetFor, CooMetRev), the
+// methylation up to Tol (bedMethyl percentages are parsed as floats)
+bool compare_coomet(const List& a, const List& b, double Tol) {
+    if (a.size() != 2 || b.size() != 2) return false;
+    for (int s = 0; s < 2; ++s) {
+        List strandA = a[s], strandB = b[s];
+        if (strandA.size() != strandB.size()) return false;
+        for (int i = 0; i < strandA.size(); ++i) {
+            DataFrame dfA = as<DataFrame>(strandA[i]);
+            DataFrame dfB = as<DataFrame>(strandB[i]);
+            NumericVector cooA = dfA["ColCoo"], cooB = dfB["ColCoo"];
+            NumericVector metA = dfA["ColMet"], metB = dfB["ColMet"];
+            if (cooA.size() != cooB.size() || metA.size() != metB.size()) return false;
+            for (int j = 0; j < cooA.size(); ++j) {
+                if (cooA[j] != cooB[j] || std::abs(metA[j] - metB[j]) > Tol) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Helper: Compare the SeqDic words of each chromosome of SeqChr with the
+// words of the chromosome strings Ref, at every coordinate, for the three
+// growing modes, several widths and both displacements and senses
+bool compare_seqdic_windows(const List& SeqChr, const List& Ref) {
+    if (SeqChr.size() != Ref.size()) return false;
+    const char* modes[] = {"C", "L", "R"};
+    for (int c = 0; c < Ref.size(); ++c) {
+        string seq = as<string>(as<CharacterVector>(Ref[c])[0]);
+        int n = seq.size() + 3;
+        NumericVector Coo(n);
+        for (int i = 0; i < n; ++i) Coo[i] = i + 1;
+        List CooMet = List::create(Coo, NumericVector(n));
+        for (int m = 0; m < 3; ++m) {
+            for (int w = 1; w <= 10; w += 3) {
+                for (int X = 0; X <= 1; ++X) {
+                    for (int Sense = 0; Sense <= 1; ++Sense) {
+                        List cpp_out = SeqDic(CooMet, NumericVector::create(w), NumericVector::create(n), VECTOR_ELT(SeqChr, c),
+                                              NumericVector::create((double) seq.size()), CharacterVector::create(modes[m]),
+                                              NumericVector::create(X), NumericVector::create(Sense));
+                        CharacterVector words = cpp_out[0];
+                        CharacterVector expected = call_SeqDic_R(seq, Coo, w, modes[m], X, Sense);
+                        for (int i = 0; i < n; ++i) {
+                            if (words[i] != expected[i]) return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Helper: two chromosomes with repeated CpG words, a gap and CpGs at both
+// ends, for the word dictionary tests
+List dicword_test_genome() {
+    List SeqChr(2);
+    SeqChr[0] = CharacterVector::create(
+        "ttcgaacgatcggacgtctcggacgttaacgttaaacgacgttattcgaaaacgacgttaaacgcgatcgacgttaacgttagacgtcga"
+        "nnnnacgttacgatcgacgttaaacggacgtcacgttaaacgacgttacgatcgtcggtcggaacgacgtta");
+    SeqChr[1] = CharacterVector::create("cgatcgacgttaacgttagacgtcg");
+    return SeqChr;
+}
+
+// Helper: targets at every CpG of SeqChr (1-based coordinate of its G),
+// with methylation spread over [0, 1]
+List dicword_test_targets(const List& SeqChr) {
+    List CooMet(SeqChr.size());
+    int k = 0;
+    for (int c = 0; c < SeqChr.size(); ++c) {
+        string seq = as<string>(as<CharacterVector>(SeqChr[c])[0]);
+        vector<double> coo, met;
+        for (size_t i = 0; i + 1 < seq.size(); ++i) {
+            if (seq[i] == 'c' && seq[i + 1] == 'g') {
+                coo.push_back(i + 2);
+                met.push_back((k++ * 37 % 101) / 100.0);
+            }
+        }
+        CooMet[c] = DataFrame::create(
+            Named("ColCoo") = NumericVector(coo.begin(), coo.end()),
+            Named("ColMet") = NumericVector(met.begin(), met.end())
+        );
+    }
+    return CooMet;
+}
+
 // Test function
 void test_ReadFasta() {
     Rcout << "Testing ReadFasta_cpp vs ReadFasta (R)... \n";
@@ -685,6 +1116,674 @@ void test_ResisMet() {
     }
 }
 
+// Test PartitionMet_cpp against R DelGaps followed by ProneMet and ResisMet
+void test_PartitionMet() {
+    Rcout << "Testing PartitionMet_cpp vs DelGaps+ProneMet/ResisMet (R)... \n";
+    List Config = List::create(
+        Named("w_min") = 2,
+        Named("w_max") = 4,
+        Named("MethProne") = 0.7,
+        Named("MethResis") = 0.3
+    );
+    List SeqMetFreW(4);
+    SeqMetFreW[0] = R_NilValue;
+    // w=2: gaps only
+    SeqMetFreW[1] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("nnnnnn", "acNgta"),
+        Named("Methyl") = NumericVector::create(0.9, 0.1),
+        Named("Freq") = IntegerVector::create(3, 4),
+        Named("Index") = IntegerVector::create(1, 2)
+    );
+    // w=3: prone, resistant, neutral and gapped words, thresholds included
+    SeqMetFreW[2] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("acgtacgt", "ttttnccc", "ccgcgcgg", "aacgttaa", "gacgtcag", "tacgatcg"),
+        Named("Methyl") = NumericVector::create(0.7, 0.9, 0.3, 0.5, 0.95, 0.0),
+        Named("Freq") = IntegerVector::create(10, 5, 4, 3, 6, 7),
+        Named("Index") = IntegerVector::create(1, 2, 3, 4, 5, 6)
+    );
+    // w=4: no gaps, no resistant words
+    SeqMetFreW[3] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("ggggaaaaccgg", "ttttccccaaga"),
+        Named("Methyl") = NumericVector::create(0.8, 0.5),
+        Named("Freq") = IntegerVector::create(3, 3),
+        Named("Index") = IntegerVector::create(3, 4)
+    );
+    List NoGaps = call_DelGaps_R(Config, SeqMetFreW);
+    List prone_r = call_ProneMet_R(Config, NoGaps);
+    List resis_r = call_ResisMet_R(Config, NoGaps);
+    List cpp_out = PartitionMet_cpp(Config, SeqMetFreW, false, true);
+    // Without the gap scan, as in the pipeline, on words without gaps
+    List cpp_nogaps = PartitionMet_cpp(Config, NoGaps, false, false);
+    bool ok = compare_pronemet_lists(prone_r, cpp_out["Prone"]) &&
+              compare_resismet_lists(resis_r, cpp_out["Resis"]) &&
+              compare_pronemet_lists(prone_r, cpp_nogaps["Prone"]) &&
+              compare_resismet_lists(resis_r, cpp_nogaps["Resis"]);
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test Fusion_cpp against the R FuseSeq in the three growing modes
+void test_Fusion() {
+    Rcout << "Testing Fusion_cpp vs FuseSeq (R)... \n";
+    List SeqMetFreW(3);
+    // w=1: each word is the inner word of a word of width 2 in one mode
+    SeqMetFreW[0] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("acgt", "ttga", "ccca"),
+        Named("Methyl") = NumericVector::create(0.9, 0.2, 0.5),
+        Named("Freq") = IntegerVector::create(4, 3, 7),
+        Named("Index") = IntegerVector::create(1, 2, 3)
+    );
+    // w=2: acgt at the C, R and L offsets, ttga at C and R, ccca at L
+    SeqMetFreW[1] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("aacgtc", "acgtgg", "ggacgt", "tttgaa", "ttgacc", "ccccca"),
+        Named("Methyl") = NumericVector::create(0.1, 0.6, 0.3, 0.8, 0.4, 0.7),
+        Named("Freq") = IntegerVector::create(2, 5, 3, 6, 1, 2),
+        Named("Index") = IntegerVector::create(4, 5, 6, 7, 8, 9)
+    );
+    // w=3: the words of width 2 at the three offsets, and a void one
+    SeqMetFreW[2] = DataFrame::create(
+        Named("Seq") = CharacterVector::create("gaacgtcg", "acgtggtt", "ttggacgt", "atttgaac", "gggggggg"),
+        Named("Methyl") = NumericVector::create(0.5, 0.2, 0.9, 0.3, 0.6),
+        Named("Freq") = IntegerVector::create(3, 2, 4, 5, 1),
+        Named("Index") = IntegerVector::create(10, 11, 12, 13, 14)
+    );
+    // Constant frequency vectors, as built by FreqVec.
+    List FreVecW(3);
+    for (int w = 1; w <= 3; ++w) {
+        IntegerVector fre = as<DataFrame>(SeqMetFreW[w - 1])["Freq"];
+        FreVecW[w - 1] = List::create(
+            Named("Base") = clone(fre),
+            Named("RowPtr") = IntegerVector(fre.size() + 1),
+            Named("Col") = IntegerVector(0),
+            Named("Val") = IntegerVector(0),
+            Named("Len") = 2*w + 2
+        );
+    }
+    bool ok = true;
+    const char* modes[] = {"C", "L", "R"};
+    for (int m = 0; m < 3; ++m) {
+        List Config = List::create(
+            Named("w_min") = 1,
+            Named("w_max") = 3,
+            Named("nCPU") = 2,
+            Named("GrowingMode") = modes[m]
+        );
+        List r_out = call_FuseSeq_R(Config, SeqMetFreW);
+        List cpp_out = Fusion_cpp(Config, SeqMetFreW, FreVecW);
+        if (!compare_fusion_lists(r_out, cpp_out, 1, 3)) {
+            Rcout << "  GrowingMode " << modes[m] << " differs\n";
+            ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test find_strings_hash against find_strings_seq
+void test_FindStrings() {
+    Rcout << "Testing find_strings_hash vs find_strings_seq...\n";
+    // Repeated words on both sides, words of out without a match in in
+    // (empty groups) at both ends, and an empty word
+    StringVector in_str = StringVector::create("acgt", "ttga", "acgt", "ccca", "ggtt", "ttga", "acgt", "");
+    StringVector out_str = StringVector::create("gggg", "acgt", "ccca", "aaaa", "ttga", "acgt", "", "ccca", "tttt");
+    const char* fields[] = {"str_indexes", "subindexes", "ind_not_void", "seqs_to_rm"};
+    bool ok = true;
+    List seq_out = find_strings_seq(in_str, out_str);
+    for (int num_cpu = 1; num_cpu <= 4; num_cpu *= 2) {
+        List hash_out = find_strings_hash(in_str, out_str, num_cpu);
+        for (int f = 0; f < 4; ++f) {
+            IntegerVector a = seq_out[fields[f]];
+            IntegerVector b = hash_out[fields[f]];
+            bool same = a.size() == b.size();
+            for (int j = 0; same && j < a.size(); ++j) {
+                if (a[j] != b[j]) same = false;
+            }
+            if (!same) {
+                Rcout << "  " << fields[f] << " differs with " << num_cpu << " threads\n";
+                ok = false;
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test DicWordCanonical_cpp against DicWord_cpp on each strand: on
+// strand-symmetric targets, the tables of each strand must be those of
+// the two-dictionary path
+void test_DicWordCanonical() {
+    Rcout << "Testing DicWordCanonical_cpp vs DicWord_cpp for/rev...\n";
+    List SeqChr = dicword_test_genome();
+    List CooMetFor = dicword_test_targets(SeqChr);
+    List CooMetRev = dicword_test_targets(SeqChr);
+    bool ok = true;
+    const char* modes[] = {"C", "L", "R"};
+    for (int m = 0; m < 3; ++m) {
+        for (int sketch = 0; sketch < 2; ++sketch) {
+            List Config = List::create(
+                Named("w_min") = 1,
+                Named("w_max") = 4,
+                Named("X") = 0,
+                Named("MethProne") = 0.7,
+                Named("MethResis") = 0.3,
+                Named("ThrFre") = sketch ? 2 : 1,
+                Named("SketchWords") = (bool) sketch,
+                Named("nCPU") = 2,
+                Named("GrowingMode") = modes[m]
+            );
+            List canonical = DicWordCanonical_cpp(Config, CooMetFor, CooMetRev, SeqChr);
+            List forward = DicWord_cpp(Config, CooMetFor, SeqChr, "for");
+            List reverse = DicWord_cpp(Config, CooMetRev, SeqChr, "rev");
+            if (!compare_dicword_results(forward, canonical["For"], 1, 4) ||
+                !compare_dicword_results(reverse, canonical["Rev"], 1, 4)) {
+                Rcout << "  GrowingMode " << modes[m] << (sketch ? " with sketch" : "") << " differs\n";
+                ok = false;
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test DicWord_cpp against the R dictionaries, on both strands, in the three
+// growing modes, with and without a displacement and a frequency threshold
+void test_DicWord() {
+    Rcout << "Testing DicWord_cpp vs DicWord (R)...\n";
+    List SeqChr = dicword_test_genome();
+    List CooMet = dicword_test_targets(SeqChr);
+    // A target without methylation
+    NumericVector Met = as<DataFrame>(CooMet[0])["ColMet"];
+    Met[3] = NA_REAL;
+    bool ok = true;
+    const char* modes[] = {"C", "L", "R"};
+    const char* senses[] = {"for", "rev"};
+    for (int m = 0; m < 3; ++m) {
+        for (int s = 0; s < 2; ++s) {
+            for (int X = 0; X <= 1; ++X) {
+                for (int ThrFre = 1; ThrFre <= 2; ++ThrFre) {
+                    List Config = List::create(
+                        Named("w_min") = 1,
+                        Named("w_max") = 4,
+                        Named("X") = X,
+                        Named("MethProne") = 0.7,
+                        Named("MethResis") = 0.3,
+                        Named("ThrFre") = ThrFre,
+                        Named("nCPU") = 2,
+                        Named("GrowingMode") = modes[m]
+                    );
+                    List r_out = call_DicWord_R(Config, CooMet, SeqChr, senses[s]);
+                    List cpp_out = DicWord_cpp(Config, CooMet, SeqChr, senses[s]);
+                    if (!compare_dicword_results(r_out, cpp_out, 1, 4)) {
+                        Rcout << "  GrowingMode " << modes[m] << " " << senses[s] << " X " << X << " ThrFre " << ThrFre << " differs\n";
+                        ok = false;
+                    }
+                }
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test SignalCache against ReadCooMetFiles: the signal written to the
+// cache and mapped back must be identical to the parsed one, whatever
+// the bits asked for
+void test_SignalCache() {
+    Rcout << "Testing SignalCache vs ReadCooMetFiles (R)...\n";
+    Function ReadCooMetFiles = get_DMMD_function("ReadCooMetFiles");
+    Function SignalCache = get_DMMD_function("SignalCache");
+    Function identical("identical");
+    Function tempfile("tempfile");
+    bool ok = true;
+    // Percentages with 3 decimals (32 bits) and with up to 1 (8 bits)
+    const char* files[] = {"mixed.bed", "percent.bed"};
+    for (int f = 0; f < 2; ++f) {
+        for (int Bits = 8; Bits <= 32; Bits *= 2) {
+            List Config = List::create(
+                Named("NumAutosomes") = 1,
+                Named("Allosomes") = CharacterVector::create("X"),
+                Named("MotifTarget") = "CG",
+                Named("InputFormat") = "bedmethyl",
+                Named("DirDat") = "test_bedmethyl",
+                Named("SignalFile") = files[f],
+                Named("CacheDir") = tempfile("dmmd_cache"),
+                Named("SignalBits") = Bits
+            );
+            List parsed = ReadCooMetFiles(Config);
+            List written = SignalCache(Config);
+            List mapped = SignalCache(Config);
+            if (!as<bool>(identical(parsed, written)) || !as<bool>(identical(parsed, mapped))) {
+                Rcout << "  " << files[f] << " with " << Bits << " bits differs\n";
+                ok = false;
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test ReadBedMethyl_cpp against the fread reader, on a plain and a
+// gzip compressed file
+void test_ReadBedMethyl() {
+    Rcout << "Testing ReadBedMethyl_cpp vs fread (R)...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 2,
+        Named("Allosomes") = CharacterVector::create("X")
+    );
+    bool ok = true;
+    const char* files[] = {"test_bedmethyl/mixed.bed", "test_bedmethyl/mixed.bed.gz", "test_bedmethyl/percent.bed"};
+    for (int f = 0; f < 3; ++f) {
+        List r_out = call_ReadBedMethyl_R(Config, files[f]);
+        List cpp_out = ReadBedMethyl_cpp(Config, files[f]);
+        if (!compare_coomet(r_out, cpp_out, 1e-6)) {
+            Rcout << "  " << files[f] << " differs\n";
+            ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test MergeBedMethyl_cpp against the rbindlist merge: sorted replicates,
+// replicates with the chromosomes in another order and unsorted
+// coordinates (rep3), and with a chromosome split in two blocks (rep4)
+void test_MergeBedMethyl() {
+    Rcout << "Testing MergeBedMethyl_cpp vs rbindlist (R)...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 2,
+        Named("Allosomes") = CharacterVector::create("X")
+    );
+    vector<CharacterVector> sets = {
+        CharacterVector::create("test_bedmethyl_merge/rep1.bed", "test_bedmethyl_merge/rep2.bed"),
+        CharacterVector::create("test_bedmethyl_merge/rep1.bed", "test_bedmethyl_merge/rep2.bed", "test_bedmethyl_merge/rep3.bed"),
+        CharacterVector::create("test_bedmethyl_merge/rep1.bed", "test_bedmethyl_merge/rep3.bed", "test_bedmethyl_merge/rep4.bed")
+    };
+    bool ok = true;
+    for (size_t k = 0; k < sets.size(); ++k) {
+        for (int Weighted = 0; Weighted < 2; ++Weighted) {
+            for (int MinDepth = 0; MinDepth <= 10; MinDepth += 10) {
+                List r_out = call_MergeBedMethyl_R(Config, sets[k], Weighted, MinDepth);
+                List cpp_out = MergeBedMethyl_cpp(Config, sets[k], Weighted, MinDepth);
+                if (!compare_coomet(r_out, cpp_out, 1e-6)) {
+                    Rcout << "  set " << k + 1 << (Weighted ? " weighted" : "") << " with MinDepth " << MinDepth << " differs\n";
+                    ok = false;
+                }
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test ReadPB3Seq_cpp against the read.table reader, which checks that the
+// reverse strand of chrX comes from its reverse file, and the warning
+// about malformed lines
+void test_ReadPB3Seq() {
+    Rcout << "Testing ReadPB3Seq_cpp vs read.table (R)...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 1,
+        Named("Allosomes") = CharacterVector::create("X"),
+        Named("MotifTarget") = "CG",
+        Named("nCPU") = 2
+    );
+    List r_out = call_ReadPB3Seq_R(Config, "test_pb3seq");
+    List cpp_out = ReadPB3Seq_cpp(Config, "test_pb3seq");
+    bool ok = compare_coomet(r_out, cpp_out, 1e-12);
+
+    // The malformed line is skipped, and reported once.
+    List malformed = call_ReadPB3Seq_malformed(Config, "test_pb3seq");
+    CharacterVector warnings = malformed["Warnings"];
+    if (!compare_coomet(r_out, malformed["CooMet"], 1e-12) || warnings.size() != 1 ||
+        as<string>(warnings[0]).find("skipped 1 malformed lines") == string::npos) {
+        Rcout << "  malformed line not reported\n";
+        ok = false;
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test the filters of the signal readers (coverage, methylation range,
+// chromosomes and BED regions, alone and together) against the same
+// filters applied to the fread reader's data frame
+void test_SignalFilter() {
+    Rcout << "Testing SignalFilter vs filtered fread (R)...\n";
+    List Filters = List::create(
+        Named("MinCoverage") = 9,
+        Named("MetRange") = NumericVector::create(0.3, 0.7),
+        Named("SignalChromosomes") = CharacterVector::create("chr1", "chrX"),
+        Named("SignalRegions") = "test_bedmethyl/regions.bed"
+    );
+    CharacterVector names = Filters.names();
+    bool ok = true;
+    for (int k = 0; k <= Filters.size(); ++k) {
+        List Config = List::create(
+            Named("NumAutosomes") = 2,
+            Named("Allosomes") = CharacterVector::create("X")
+        );
+        // One filter each, then all of them
+        for (int i = 0; i < Filters.size(); ++i) {
+            if (k == Filters.size() || k == i) Config.push_back((SEXP) Filters[i], as<string>(names[i]));
+        }
+        List r_out = call_ReadBedMethyl_R(Config, "test_bedmethyl/mixed.bed");
+        List cpp_out = ReadBedMethyl_cpp(Config, "test_bedmethyl/mixed.bed");
+        if (!compare_coomet(r_out, cpp_out, 1e-6)) {
+            Rcout << "  " << (k == Filters.size() ? "all the filters" : as<string>(names[k])) << " differs\n";
+            ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test the SeqDic windows of ReadPackedGenome against those of the
+// ReadFasta strings, on a fasta file with lowercase and uppercase bases,
+// N runs and IUPAC codes
+void test_PackedGenome() {
+    Rcout << "Testing ReadPackedGenome vs ReadFasta (R) windows...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 1,
+        Named("Allosomes") = CharacterVector::create("X"),
+        Named("DirFas") = copy_test_dir("test_genome")
+    );
+    Function ReadPackedGenome = get_DMMD_function("ReadPackedGenome");
+    Function tempfile("tempfile");
+    Function tempdir("tempdir");
+    List Ref = call_ReadFasta_R(Config);
+    List SeqChr = ReadPackedGenome(Config, tempfile("genome", tempdir(), ".2bit"));
+    if (compare_seqdic_windows(SeqChr, Ref)) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test the SeqDic windows of ReadFastaIndex, which builds the .fai indexes
+// of the copied fixtures, against those of the ReadFasta strings
+void test_FastaIndex() {
+    Rcout << "Testing ReadFastaIndex vs ReadFasta (R) windows...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 1,
+        Named("Allosomes") = CharacterVector::create("X"),
+        Named("DirFas") = copy_test_dir("test_genome")
+    );
+    Function ReadFastaIndex = get_DMMD_function("ReadFastaIndex");
+    List Ref = call_ReadFasta_R(Config);
+    // Built on the first call, loaded from the .fai files on the second
+    bool ok = compare_seqdic_windows(ReadFastaIndex(Config), Ref) &&
+              compare_seqdic_windows(ReadFastaIndex(Config), Ref);
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test ReadFasta_cpp and ReadPackedGenome on a gzip (chr1) and a BGZF
+// (chrX) compressed copy of the fixtures against the ReadFasta strings of
+// the plain files, and that both stop on truncated or corrupt files
+void test_CompressedFasta() {
+    Rcout << "Testing ReadFasta_cpp/ReadPackedGenome on gzip and BGZF files vs ReadFasta (R)...\n";
+    List Config = List::create(
+        Named("NumAutosomes") = 1,
+        Named("Allosomes") = CharacterVector::create("X"),
+        Named("DirFas") = copy_test_dir("test_genome")
+    );
+    List Ref = call_ReadFasta_R(Config);
+    Function ReadPackedGenome = get_DMMD_function("ReadPackedGenome");
+    Function tempfile("tempfile");
+    Function tempdir("tempdir");
+
+    Config["DirFas"] = copy_test_dir("test_genome_gz");
+    List SeqChr = ReadFasta_cpp(Config);
+    bool ok = compare_seq_lists(Ref, SeqChr) && compare_seqdic_windows(SeqChr, Ref) &&
+              compare_seqdic_windows(ReadPackedGenome(Config, tempfile("genome", tempdir(), ".2bit")), Ref);
+
+    const char* files[] = {"chr1.fa.gz", "chrX.fa.gz"};
+    const char* modes[] = {"truncate", "corrupt"};
+    for (int f = 0; f < 2; ++f) {
+        for (int m = 0; m < 2; ++m) {
+            string Dir = copy_test_dir("test_genome_gz");
+            damage_file(Dir + "/" + files[f], modes[m]);
+            Config["DirFas"] = Dir;
+            for (int reader = 0; reader < 2; ++reader) {
+                bool stopped = false;
+                try {
+                    if (reader == 0) ReadFasta_cpp(Config);
+                    else ReadPackedGenome(Config, tempfile("genome", tempdir(), ".2bit"));
+                } catch (std::exception&) {
+                    stopped = true;
+                }
+                if (!stopped) {
+                    Rcout << "  " << (reader == 0 ? "ReadFasta_cpp" : "ReadPackedGenome") << " did not stop on " << files[f] << " (" << modes[m] << ")\n";
+                    ok = false;
+                }
+            }
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test that GenomeCache builds the image once, maps it while the fasta
+// files do not change, and builds it again when they do: detected by
+// modification time, or with CacheHash "md5" by content even when the size
+// and modification time are kept. Its windows must be those of the
+// ReadFasta strings of the files at each step.
+void test_GenomeCache() {
+    Rcout << "Testing GenomeCache invalidation vs ReadFasta (R) windows...\n";
+    Function tempfile("tempfile");
+    string Dir = copy_test_dir("test_genome");
+    List Config = List::create(
+        Named("NumAutosomes") = 1,
+        Named("Allosomes") = CharacterVector::create("X"),
+        Named("DirFas") = Dir,
+        Named("CacheDir") = tempfile("dmmd_cache"),
+        Named("CacheHash") = "mtime"
+    );
+    // Change of the fasta file before each step, whether the image must be
+    // built, and hash
+    struct Step { double shift; bool change; bool built; const char* hash; };
+    Step steps[] = {
+        {NA_REAL, false, true, "mtime"},   // first run
+        {NA_REAL, false, false, "mtime"},  // unchanged
+        {10, true, true, "mtime"},         // new modification time
+        {NA_REAL, false, true, "md5"},     // new key
+        {NA_REAL, true, true, "md5"},      // same size and time, new content
+        {NA_REAL, false, false, "md5"}     // unchanged
+    };
+    bool ok = true;
+    for (int k = 0; k < 6; ++k) {
+        if (steps[k].change) change_test_fasta(Dir, steps[k].shift);
+        Config["CacheHash"] = steps[k].hash;
+        List cached = call_GenomeCache(Config);
+        if (as<bool>(cached["Built"]) != steps[k].built ||
+            !compare_seqdic_windows(cached["SeqChr"], call_ReadFasta_R(Config))) {
+            Rcout << "  step " << k + 1 << " differs\n";
+            ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test the n-run indexes: the NRuns attribute of the ReadFasta_cpp strings
+// against the runs found in R, and the SeqDic windows checked with it, or
+// with the index SeqDic builds for the ReadFasta strings, against those cut
+// in R
+void test_NRuns() {
+    Rcout << "Testing NRuns of ReadFasta_cpp and SeqDic vs R...\n";
+    const char* dirs[] = {"test_genome", "test_fasta"};
+    bool ok = true;
+    for (int d = 0; d < 2; ++d) {
+        List Config = List::create(
+            Named("NumAutosomes") = 1,
+            Named("Allosomes") = CharacterVector::create("X"),
+            Named("DirFas") = dirs[d]
+        );
+        List Ref = call_ReadFasta_R(Config);
+        List SeqChr = ReadFasta_cpp(Config);
+        for (int c = 0; c < SeqChr.size(); ++c) {
+            CharacterVector seq = SeqChr[c];
+            SEXP attr = seq.attr("NRuns");
+            IntegerVector runs = Rf_isNull(attr) ? IntegerVector(0) : IntegerVector(attr);
+            IntegerVector expected = call_NRuns_R(as<string>(seq[0]));
+            bool same = runs.size() == expected.size();
+            for (int i = 0; same && i < runs.size(); ++i) same = runs[i] == expected[i];
+            if (!same) {
+                Rcout << "  NRuns of " << dirs[d] << " chromosome " << c + 1 << " differs\n";
+                ok = false;
+            }
+        }
+        if (!compare_seqdic_windows(SeqChr, Ref) || !compare_seqdic_windows(Ref, Ref)) {
+            Rcout << "  windows of " << dirs[d] << " differ\n";
+            ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test the complement kernels of every level the processor has against a
+// table, for lengths around the 16 and 32 byte blocks, unaligned, and in
+// place
+void test_RevComp() {
+    Rcout << "Testing comp_ascii/revcomp_ascii kernels vs table...\n";
+    const string alphabet = "acgtACGTnNRY-x";
+    const string bases = "acgtACGT", complements = "tgcaTGCA";
+    bool ok = true;
+    for (int level = REVCOMP_TABLE; level <= REVCOMP_AVX2; ++level) {
+        if (revcomp_select(level) != 0) continue;
+        for (int len = 0; len <= 100; ++len) {
+            for (int off = 0; off < 4; ++off) {
+                string in(off + len, ' '), comp(len, ' '), rev(len, ' ');
+                for (int i = 0; i < off + len; ++i) in[i] = alphabet[(i * 7 + len * 3 + off) % alphabet.size()];
+                for (int i = 0; i < len; ++i) {
+                    size_t b = bases.find(in[off + i]);
+                    comp[i] = b == string::npos ? in[off + i] : complements[b];
+                    rev[len - 1 - i] = comp[i];
+                }
+                vector<char> out(off + len + 1);
+                comp_ascii(&in[off], &out[off], len);
+                if (string(&out[off], len) != comp) ok = false;
+                revcomp_ascii(&in[off], &out[off], len);
+                if (string(&out[off], len) != rev) ok = false;
+                comp_ascii(&in[off], &in[off], len);
+                if (in.substr(off) != comp) ok = false;
+            }
+        }
+        if (!ok) {
+            Rcout << "  level " << level << " differs\n";
+            break;
+        }
+    }
+    revcomp_init();
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test TopK_cpp against the rows ReduceWords used to keep with sort.list
+void test_TopK() {
+    Rcout << "Testing TopK_cpp vs sort.list (R)...\n";
+    // Ties, an NA and K at both ends
+    NumericVector Freq = NumericVector::create(5, 3, 9, 3, NA_REAL, 1, 9, 3, 7, 0);
+    Function sortList("sort.list");
+    IntegerVector Order = sortList(Freq);
+    int n = Freq.size();
+    bool ok = true;
+    for (int K = 0; K <= n + 1; ++K) {
+        vector<int> keep(n, 1);
+        for (int i = 0; i < n - K; ++i) keep[Order[i] - 1] = 0;
+        vector<int> expected;
+        for (int i = 0; i < n; ++i) {
+            if (keep[i]) expected.push_back(i + 1);
+        }
+        IntegerVector cpp_out = TopK_cpp(Freq, K);
+        if (cpp_out.size() != (int) expected.size()) {
+            ok = false;
+            continue;
+        }
+        for (int i = 0; i < cpp_out.size(); ++i) {
+            if (cpp_out[i] != expected[i]) ok = false;
+        }
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
+// Test packed words against their strings and RevTot_cpp
+void test_PackWords() {
+    Rcout << "Testing PackWords_cpp/RevPackedWords_cpp vs RevTot_cpp...\n";
+    List Config = List::create(
+        Named("w_min") = 35,
+        Named("w_max") = 35
+    );
+    // 72 bases: the widest word, across the three packed integers.
+    string base = "acgtacgtttgcaaccggtaacgtacgtacgtagctagctagcatcgatcgatcgggtacctagcatgcaag";
+    CharacterVector seqs = CharacterVector::create(base, string(base.rbegin(), base.rend()), string(72, 't'));
+    List Seqs(35);
+    Seqs[34] = seqs;
+
+    NumericMatrix Kmer = PackWords_cpp(seqs, 72);
+    CharacterVector unpacked = UnpackWords_cpp(Kmer);
+    CharacterVector rev = UnpackWords_cpp(RevPackedWords_cpp(Kmer));
+    CharacterVector expected = as<List>(RevTot_cpp(Config, Seqs))[34];
+
+    bool ok = true;
+    for (int i = 0; i < seqs.size(); ++i) {
+        if (unpacked[i] != seqs[i] || rev[i] != expected[i]) ok = false;
+    }
+    if (ok) {
+        Rcout << "\033[32mPASS\033[0m\n";
+    } else {
+        Rcout << "\033[31mFAIL\033[0m\n";
+    }
+}
+
 // Main
 int main() {
     int argc = 2;
@@ -695,7 +1794,7 @@ int main() {
     run_R_code("if (requireNamespace('Rcpp', quietly=TRUE)) {\n  library(Rcpp);\n  cat('Embedded Rcpp version:', as.character(packageVersion('Rcpp')), '\n');\n  print(getLoadedDLLs()[['Rcpp']]);\n} else {\n  cat('Rcpp not found in embedded R .libPaths()\\n');\n}");
 
     // Ensure the R implementation of ReadFasta is available
-    run_R_code("if (requireNamespace('DMMD', quietly=TRUE)) {\n  library(DMMD);\n} else {\n  source('../R/MethylDNAFunc.R');\n}");
+    run_R_code("if (requireNamespace('DMMD', quietly=TRUE)) {\n  library(DMMD);\n} else {\n  source('../R/MethylDNAFunc.R');\n  source('../R/fusion.R');\n  source('../R/wgbs_data_read.R');\n  source('../R/genome_cache.R');\n}");
     
     test_CooMov();
     test_ReadFasta();
@@ -705,6 +1804,24 @@ int main() {
     test_DelGapsTot();
     test_ProneMet();
     test_ResisMet();
+    test_PartitionMet();
+    test_Fusion();
+    test_FindStrings();
+    test_PackWords();
+    test_TopK();
+    test_DicWord();
+    test_DicWordCanonical();
+    test_SignalCache();
+    test_ReadBedMethyl();
+    test_MergeBedMethyl();
+    test_ReadPB3Seq();
+    test_SignalFilter();
+    test_PackedGenome();
+    test_FastaIndex();
+    test_CompressedFasta();
+    test_GenomeCache();
+    test_NRuns();
+    test_RevComp();
 
     Rf_endEmbeddedR(0);
     return 0;
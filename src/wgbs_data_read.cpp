@@ -0,0 +1,795 @@
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_map>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <omp.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fastaio.h"
+
+using namespace Rcpp;
+using namespace std;
+
+#define SIGNAL_IO_BUF (1 << 22)
+
+// Helper: index of each chromosome name of the configuration (chr1..chrN,
+// then the allosomes), in the order of the CooMet lists.
+static unordered_map<string, int> chromosome_index(List Config) {
+    int NumAutosomes = as<int>(Config["NumAutosomes"]);
+    CharacterVector Allosomes = Config.containsElementNamed("Allosomes") && !Rf_isNull(Config["Allosomes"])
+        ? as<CharacterVector>(Config["Allosomes"]) : CharacterVector(0);
+
+    unordered_map<string, int> index;
+    for (int i1 = 0; i1 < NumAutosomes; i1++) {
+        index["chr" + to_string(i1 + 1)] = i1;
+    }
+    for (int i2 = 0; i2 < Allosomes.size(); i2++) {
+        index["chr" + as<string>(Allosomes[i2])] = NumAutosomes + i2;
+    }
+    return index;
+}
+
+// Columnar coordinates and methylation of one chromosome and strand.
+struct SignalBucket {
+    vector<int> coo;
+    vector<float> met;
+};
+
+// Reader of the lines of a plain or compressed text file. It does not use the
+// R API, so several readers can run in parallel; errors are kept in error().
+class LineReader {
+public:
+    LineReader(const string& path) : path(path), buf(SIGNAL_IO_BUF + 1), start(0), end(0), eof(false) {
+        char err_open[256];
+        fs = fa_stream_open(path.c_str(), 1, err_open, sizeof(err_open));
+        if (fs == NULL) err = err_open;
+    }
+
+    ~LineReader() {
+        fa_stream_close(fs);
+    }
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    // Next line, NUL terminated in place. Returns false at the end of the
+    // file or on error.
+    bool next(char*& line, char*& line_end) {
+        if (fs == NULL) return false;
+        for (;;) {
+            char* nl = (char*) memchr(buf.data() + start, '\n', end - start);
+            if (nl != NULL) {
+                *nl = '\0';
+                line = buf.data() + start;
+                line_end = nl;
+                start = (size_t) (nl - buf.data()) + 1;
+                return true;
+            }
+            if (eof) {
+                if (start == end) return false;
+                // Last line without a newline.
+                buf[end] = '\0';
+                line = buf.data() + start;
+                line_end = buf.data() + end;
+                start = end;
+                return true;
+            }
+            // Keep the incomplete line and read more.
+            memmove(buf.data(), buf.data() + start, end - start);
+            end -= start;
+            start = 0;
+            if (end == buf.size() - 1) buf.resize(2 * buf.size());
+            long got = fa_stream_read(fs, buf.data() + end, buf.size() - 1 - end);
+            if (got < 0) {
+                err = "error while reading " + path + ": " + fa_stream_error(fs);
+                return false;
+            }
+            if (got == 0) eof = true;
+            end += (size_t) got;
+        }
+    }
+
+    // Empty if there was no error.
+    const string& error() const {
+        return err;
+    }
+
+private:
+    string path;
+    FaStream* fs;
+    vector<char> buf;
+    size_t start, end;
+    bool eof;
+    string err;
+};
+
+// Helper: true if the element Name of the configuration is set (not NULL
+// and not NA).
+static bool config_set(List Config, const char* Name) {
+    if (!Config.containsElementNamed(Name)) return false;
+    SEXP x = Config[Name];
+    if (Rf_isNull(x) || Rf_length(x) == 0) return false;
+    if (Rf_length(x) == 1 && (Rf_isLogical(x) || Rf_isReal(x) || Rf_isString(x))) {
+        if (Rf_isLogical(x) && LOGICAL(x)[0] == NA_LOGICAL) return false;
+        if (Rf_isReal(x) && ISNA(REAL(x)[0])) return false;
+        if (Rf_isString(x) && STRING_ELT(x, 0) == NA_STRING) return false;
+    }
+    return true;
+}
+
+// Filters applied while the call files are parsed, so that sites that are
+// not wanted are never stored:
+//   Config$MinCoverage       minimum coverage of a call (bedMethyl column 10)
+//   Config$MetRange          c(min, max), methylation frequencies kept
+//   Config$SignalChromosomes chromosomes kept, e.g. c("chr1", "chrX"); the
+//                            others get empty data frames
+//   Config$SignalRegions     BED file (plain or compressed); only sites
+//                            within its regions are kept
+struct SignalFilter {
+    int min_cov = 0;
+    double met_min = -INFINITY, met_max = INFINITY;
+    vector<char> keep_chr;
+    bool has_regions = false;
+    vector<vector<pair<int, int> > > regions;   // per chromosome, sorted and disjoint [begin, end)
+
+    bool chromosome(int chr) const {
+        return keep_chr[chr] != 0;
+    }
+
+    bool coverage(int cov) const {
+        return cov >= min_cov;
+    }
+
+    // met is a frequency in [0, 1].
+    bool methylation(double met) const {
+        return met >= met_min && met <= met_max;
+    }
+
+    bool region(int chr, int coo) const {
+        if (!has_regions) return true;
+        const vector<pair<int, int> >& r = regions[chr];
+        // First region ending after coo.
+        size_t lo = 0, hi = r.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (r[mid].second <= coo) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo < r.size() && r[lo].first <= coo;
+    }
+};
+
+// Helper: the filters of the configuration (see SignalFilter).
+static SignalFilter signal_filter(List Config, const unordered_map<string, int>& index) {
+    SignalFilter filter;
+    int nChr = index.size();
+
+    if (config_set(Config, "MinCoverage")) {
+        filter.min_cov = as<int>(Config["MinCoverage"]);
+    }
+    if (config_set(Config, "MetRange")) {
+        NumericVector MetRange = as<NumericVector>(Config["MetRange"]);
+        if (MetRange.size() != 2 || !(MetRange[0] <= MetRange[1])) {
+            stop("MetRange must be c(min, max) with min <= max");
+        }
+        filter.met_min = MetRange[0];
+        filter.met_max = MetRange[1];
+    }
+
+    filter.keep_chr.assign(nChr, 1);
+    if (config_set(Config, "SignalChromosomes")) {
+        CharacterVector Keep = as<CharacterVector>(Config["SignalChromosomes"]);
+        filter.keep_chr.assign(nChr, 0);
+        for (int i = 0; i < Keep.size(); i++) {
+            unordered_map<string, int>::const_iterator it = index.find(as<string>(Keep[i]));
+            if (it == index.end()) {
+                stop("SignalChromosomes: %s is not a chromosome of the configuration", as<string>(Keep[i]));
+            }
+            filter.keep_chr[it->second] = 1;
+        }
+    }
+
+    if (config_set(Config, "SignalRegions")) {
+        string Path = as<string>(Config["SignalRegions"]);
+        filter.has_regions = true;
+        filter.regions.resize(nChr);
+        LineReader reader(Path);
+        char *line, *end;
+        while (reader.next(line, end)) {
+            if (line == end || line[0] == '#' || strncmp(line, "track", 5) == 0 || strncmp(line, "browser", 7) == 0) continue;
+            char* tab1 = (char*) memchr(line, '\t', end - line);
+            if (tab1 == NULL) continue;
+            *tab1 = '\0';
+            unordered_map<string, int>::const_iterator it = index.find(line);
+            if (it == index.end()) continue;
+            char* p;
+            long b = strtol(tab1 + 1, &p, 10);
+            long e = strtol(p, NULL, 10);
+            if (e > b) filter.regions[it->second].push_back(make_pair((int) b, (int) e));
+        }
+        if (!reader.error().empty()) {
+            stop(reader.error());
+        }
+        // Sort and merge overlapping regions.
+        for (int i = 0; i < nChr; i++) {
+            vector<pair<int, int> >& r = filter.regions[i];
+            sort(r.begin(), r.end());
+            size_t k = 0;
+            for (size_t j = 0; j < r.size(); j++) {
+                if (k > 0 && r[j].first <= r[k - 1].second) r[k - 1].second = max(r[k - 1].second, r[j].second);
+                else r[k++] = r[j];
+            }
+            r.resize(k);
+        }
+    }
+    return filter;
+}
+
+// One site of a bedMethyl file.
+struct BedSite {
+    int chr;
+    int strand;   // 0 forward, 1 reverse
+    int coo;
+    float met;    // percentage
+    int cov;
+};
+
+// Helper: parses a bedMethyl line. Returns false for headers, malformed lines,
+// sites of chromosomes outside the configuration and sites dropped by the
+// chromosome, region and coverage filters.
+static bool parse_bedmethyl(char* line, char* end, const unordered_map<string, int>& index,
+                            const SignalFilter& filter, string& chr, BedSite& site) {
+    if (line == end || line[0] == '#' || strncmp(line, "track", 5) == 0 || strncmp(line, "browser", 7) == 0) return false;
+
+    // Start of each of the first 11 tab separated fields.
+    char* field[11];
+    int nField = 0;
+    char* p = line;
+    field[nField++] = p;
+    while (nField < 11 && (p = (char*) memchr(p, '\t', end - p)) != NULL) {
+        *p++ = '\0';
+        field[nField++] = p;
+    }
+    if (nField < 11) return false;
+
+    chr.assign(field[0]);
+    unordered_map<string, int>::const_iterator it = index.find(chr);
+    if (it == index.end() || !filter.chromosome(it->second)) return false;
+
+    if (field[5][0] == '+') site.strand = 0;
+    else if (field[5][0] == '-') site.strand = 1;
+    else return false;
+
+    site.chr = it->second;
+    site.coo = (int) strtol(field[1], NULL, 10);
+    site.cov = (int) strtol(field[9], NULL, 10);
+    site.met = strtof(field[10], NULL);
+    return filter.coverage(site.cov) && filter.region(site.chr, site.coo);
+}
+
+// Helper: methylation frequency of a percentage as the readers hold it.
+static inline double signal_frequency(float pct) {
+    return (double) pct / 100.0;
+}
+
+// Helper: the CooMet structure, list(CooMetFor, CooMetRev), from the buckets.
+static List signal_to_coomet(vector<SignalBucket>& For, vector<SignalBucket>& Rev) {
+    List CooMetFor(For.size()), CooMetRev(Rev.size());
+    for (size_t i = 0; i < For.size(); i++) {
+        for (int s = 0; s < 2; s++) {
+            SignalBucket& b = s == 0 ? For[i] : Rev[i];
+            IntegerVector ColCoo(b.coo.begin(), b.coo.end());
+            NumericVector ColMet(b.met.size());
+            for (size_t j = 0; j < b.met.size(); j++) ColMet[j] = signal_frequency(b.met[j]);
+            DataFrame df = DataFrame::create(Named("ColCoo") = ColCoo, Named("ColMet") = ColMet);
+            if (s == 0) CooMetFor[i] = df; else CooMetRev[i] = df;
+            vector<int>().swap(b.coo);
+            vector<float>().swap(b.met);
+        }
+    }
+    return List::create(CooMetFor, CooMetRev);
+}
+
+// [[Rcpp::export]]
+List ReadBedMethyl_cpp(List Config, std::string Path) {
+    // Reads a bedMethyl file (plain or gzip/BGZF compressed) in one pass and
+    // splits its sites by chromosome and strand. Returns list(CooMetFor, CooMetRev),
+    // one data.frame(ColCoo, ColMet) per chromosome of the configuration, with
+    // the start coordinate (column 2) and the methylation percentage
+    // (column 11) divided by 100. Other chromosomes, and the sites dropped by
+    // the filters of the configuration (see SignalFilter), are skipped.
+    unordered_map<string, int> index = chromosome_index(Config);
+    SignalFilter filter = signal_filter(Config, index);
+    vector<SignalBucket> For(index.size()), Rev(index.size());
+
+    LineReader reader(Path);
+    string chr;
+    BedSite site;
+    char *line, *end;
+    while (reader.next(line, end)) {
+        if (!parse_bedmethyl(line, end, index, filter, chr, site)) continue;
+        if (!filter.methylation(site.met / 100.0)) continue;
+        SignalBucket& b = site.strand == 0 ? For[site.chr] : Rev[site.chr];
+        b.coo.push_back(site.coo);
+        b.met.push_back(site.met);
+    }
+    if (!reader.error().empty()) {
+        stop(reader.error());
+    }
+
+    return signal_to_coomet(For, Rev);
+}
+
+// Pooled sites of one chromosome and strand, while merging replicates.
+struct MergeBucket {
+    vector<int> coo;
+    vector<double> sum;      // sum of (weighted) percentages
+    vector<double> weight;   // number of replicates, or coverage
+    vector<int> depth;       // pooled coverage
+    bool unsorted = false;
+
+    void add(const BedSite& site, bool Weighted) {
+        double w = Weighted ? (double) site.cov : 1.0;
+        if (!coo.empty() && coo.back() == site.coo) {
+            sum.back() += w * site.met;
+            weight.back() += w;
+            depth.back() += site.cov;
+            return;
+        }
+        if (!coo.empty() && site.coo < coo.back()) unsorted = true;
+        coo.push_back(site.coo);
+        sum.push_back(w * site.met);
+        weight.push_back(w);
+        depth.push_back(site.cov);
+    }
+
+    // Sorts and coalesces the sites of inputs that were not sorted
+    // (e.g. chromosomes in a different order), then averages them.
+    void finish(int MinDepth, const SignalFilter& filter, SignalBucket& out) {
+        size_t n = coo.size();
+        vector<size_t> ord(n);
+        for (size_t i = 0; i < n; i++) ord[i] = i;
+        if (unsorted) {
+            stable_sort(ord.begin(), ord.end(), [&](size_t a, size_t b) { return coo[a] < coo[b]; });
+        }
+        size_t i = 0;
+        while (i < n) {
+            size_t k = ord[i];
+            double s = sum[k], w = weight[k];
+            int d = depth[k];
+            while (++i < n && coo[ord[i]] == coo[k]) {
+                s += sum[ord[i]];
+                w += weight[ord[i]];
+                d += depth[ord[i]];
+            }
+            if (d < MinDepth || w <= 0 || !filter.methylation(s / w / 100.0)) continue;
+            out.coo.push_back(coo[k]);
+            out.met.push_back((float) (s / w));
+        }
+        vector<int>().swap(coo);
+        vector<double>().swap(sum);
+        vector<double>().swap(weight);
+        vector<int>().swap(depth);
+    }
+};
+
+// Helper: k-way merge of the bedMethyl files on (chromosome, coordinate).
+// With Stream, the sites of a chromosome are averaged and released as soon as
+// every file has moved past it (its block of that chromosome has ended, or
+// the file has ended), so that only the chromosomes being merged are pooled.
+// Files whose chromosomes come in another order only keep more of them
+// pooled, and their buckets are sorted when finished. Returns false, without
+// the merged sites, if a file comes back to a chromosome already released.
+static bool merge_bedmethyl(CharacterVector Paths, const unordered_map<string, int>& index,
+                            const SignalFilter& filter, bool Weighted, int MinDepth, bool Stream,
+                            vector<SignalBucket>& ForOut, vector<SignalBucket>& RevOut) {
+    int nChr = index.size(), nFiles = Paths.size();
+    vector<MergeBucket> For(nChr), Rev(nChr);
+    ForOut.assign(nChr, SignalBucket());
+    RevOut.assign(nChr, SignalBucket());
+
+    // passed[f][c]: file f is past chromosome c; pending[c]: number of files
+    // that are not.
+    vector<vector<char> > passed(nFiles, vector<char>(nChr, 0));
+    vector<int> pending(nChr, nFiles);
+    vector<char> released(nChr, 0);
+    bool revisited = false;
+
+    auto release = [&](int c) {
+        For[c].finish(MinDepth, filter, ForOut[c]);
+        Rev[c].finish(MinDepth, filter, RevOut[c]);
+        released[c] = 1;
+    };
+    auto pass = [&](int f, int c) {
+        if (passed[f][c]) return;
+        passed[f][c] = 1;
+        if (--pending[c] == 0 && Stream) release(c);
+    };
+
+    vector<unique_ptr<LineReader> > readers;
+    vector<BedSite> head(nFiles);
+    string chr;
+
+    // Next site of file f, or false at its end.
+    auto advance = [&](int f) -> bool {
+        char *line, *end;
+        int prev = head[f].chr;
+        while (readers[f]->next(line, end)) {
+            if (!parse_bedmethyl(line, end, index, filter, chr, head[f])) continue;
+            int c = head[f].chr;
+            if (prev >= 0 && c != prev) pass(f, prev);
+            if (passed[f][c]) {
+                // Not sorted by chromosome: undo the pass if c is still pooled.
+                if (released[c]) revisited = true;
+                passed[f][c] = 0;
+                pending[c]++;
+            }
+            return true;
+        }
+        for (int c = 0; c < nChr; c++) pass(f, c);
+        return false;
+    };
+
+    typedef pair<pair<long long, int>, int> HeapKey;   // ((chromosome, coordinate), strand), file
+    auto key = [&](int f) {
+        return make_pair(make_pair(((long long) head[f].chr << 32) | (unsigned int) head[f].coo, head[f].strand), f);
+    };
+    priority_queue<HeapKey, vector<HeapKey>, greater<HeapKey> > heap;
+
+    for (int f = 0; f < nFiles; f++) {
+        readers.push_back(unique_ptr<LineReader>(new LineReader(as<string>(Paths[f]))));
+        head[f].chr = -1;
+        if (advance(f)) heap.push(key(f));
+    }
+
+    while (!heap.empty() && !revisited) {
+        int f = heap.top().second;
+        heap.pop();
+        MergeBucket& b = head[f].strand == 0 ? For[head[f].chr] : Rev[head[f].chr];
+        b.add(head[f], Weighted);
+        if (advance(f)) heap.push(key(f));
+    }
+    for (int f = 0; f < nFiles; f++) {
+        if (!readers[f]->error().empty()) {
+            stop(readers[f]->error());
+        }
+    }
+    if (revisited) return false;
+
+    for (int c = 0; c < nChr; c++) {
+        if (!released[c]) release(c);
+    }
+    return true;
+}
+
+// [[Rcpp::export]]
+List MergeBedMethyl_cpp(List Config, CharacterVector Paths, bool Weighted, int MinDepth) {
+    // Pools several bedMethyl files (replicates) with a streaming k-way merge
+    // on (chromosome, coordinate), so that only the merged sites, and the
+    // pooled sites of the chromosomes still being read, are kept in memory.
+    // Each site gets the mean of the replicates' methylation, weighted by
+    // their coverage (column 10) if Weighted, and sites whose pooled coverage
+    // is below MinDepth are dropped. The filters of the configuration apply
+    // to each replicate's calls, but the methylation range to the merged
+    // sites. Files whose chromosomes are not in contiguous blocks are merged
+    // again, pooling every chromosome until the end. Returns the structure
+    // of ReadBedMethyl_cpp.
+    unordered_map<string, int> index = chromosome_index(Config);
+    SignalFilter filter = signal_filter(Config, index);
+    vector<SignalBucket> ForOut, RevOut;
+
+    if (!merge_bedmethyl(Paths, index, filter, Weighted, MinDepth, true, ForOut, RevOut)) {
+        merge_bedmethyl(Paths, index, filter, Weighted, MinDepth, false, ForOut, RevOut);
+    }
+    return signal_to_coomet(ForOut, RevOut);
+}
+
+// Helper: coordinate (column 2) and methylation (column 7) of a line of a
+// PB3Seq call file, whose columns are separated by blanks.
+static bool parse_pb3seq(char* line, int& coo, double& met) {
+    char* p = line;
+    for (int col = 1; col <= 7; col++) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '\r') return false;
+        if (col == 2) coo = (int) strtol(p, NULL, 10);
+        if (col == 7) {
+            met = strtod(p, NULL);
+            return true;
+        }
+        while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+    }
+    return false;
+}
+
+// [[Rcpp::export]]
+List ReadPB3Seq_cpp(List Config, std::string Dir) {
+    // Reads the PB3Seq call files chr<i>.fa.txt_forw.txt_<target> and
+    // chr<i>.fa.txt_rev.txt_<target> of every chromosome of Dir, on
+    // Config$nCPU threads. Returns list(CooMetFor, CooMetRev), with one
+    // data.frame(ColCoo, ColMet) per chromosome. The files of chromosomes
+    // left out by Config$SignalChromosomes are not read; the region and
+    // methylation filters apply too (the files have no coverage column).
+    // Lines with fewer than 7 columns are skipped, with a warning that
+    // gives the count of each file.
+    int NumAutosomes = as<int>(Config["NumAutosomes"]);
+    CharacterVector Allosomes = Config.containsElementNamed("Allosomes") && !Rf_isNull(Config["Allosomes"])
+        ? as<CharacterVector>(Config["Allosomes"]) : CharacterVector(0);
+    string MotifTarget = as<string>(Config["MotifTarget"]);
+    int nCPU = Config.containsElementNamed("nCPU") ? as<int>(Config["nCPU"]) : 1;
+
+    vector<string> chrs;
+    for (int i1 = 0; i1 < NumAutosomes; i1++) chrs.push_back(to_string(i1 + 1));
+    for (int i2 = 0; i2 < Allosomes.size(); i2++) chrs.push_back(as<string>(Allosomes[i2]));
+    int nChr = chrs.size();
+    SignalFilter filter = signal_filter(Config, chromosome_index(Config));
+
+    // File 2*i is the forward strand of chromosome i, 2*i+1 the reverse one.
+    vector<string> files(2 * nChr), errors(2 * nChr);
+    vector<long> malformed(2 * nChr, 0);
+    vector<vector<int> > coo(2 * nChr);
+    vector<vector<double> > met(2 * nChr);
+    for (int i = 0; i < nChr; i++) {
+        files[2*i] = Dir + "/chr" + chrs[i] + ".fa.txt_forw.txt_" + MotifTarget;
+        files[2*i + 1] = Dir + "/chr" + chrs[i] + ".fa.txt_rev.txt_" + MotifTarget;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(max(1, nCPU))
+    for (int f = 0; f < 2 * nChr; f++) {
+        if (!filter.chromosome(f / 2)) continue;
+        LineReader reader(files[f]);
+        char *line, *end;
+        int c;
+        double m;
+        while (reader.next(line, end)) {
+            if (!parse_pb3seq(line, c, m)) {
+                // Blank lines are not counted.
+                if (line[strspn(line, " \t\r")] != '\0') malformed[f]++;
+                continue;
+            }
+            if (!filter.methylation(m) || !filter.region(f / 2, c)) continue;
+            coo[f].push_back(c);
+            met[f].push_back(m);
+        }
+        errors[f] = reader.error();
+    }
+
+    for (int f = 0; f < 2 * nChr; f++) {
+        if (!errors[f].empty()) {
+            stop(errors[f]);
+        }
+        if (malformed[f] > 0) {
+            warning("ReadPB3Seq_cpp: skipped %ld malformed lines of %s", malformed[f], files[f].c_str());
+        }
+    }
+
+    List CooMetFor(nChr), CooMetRev(nChr);
+    for (int f = 0; f < 2 * nChr; f++) {
+        DataFrame df = DataFrame::create(
+            Named("ColCoo") = IntegerVector(coo[f].begin(), coo[f].end()),
+            Named("ColMet") = NumericVector(met[f].begin(), met[f].end())
+        );
+        if (f % 2 == 0) CooMetFor[f / 2] = df; else CooMetRev[f / 2] = df;
+        vector<int>().swap(coo[f]);
+        vector<double>().swap(met[f]);
+    }
+    return List::create(CooMetFor, CooMetRev);
+}
+
+/*
+ * Signal cache: the CooMet structure of a run in a binary file that later
+ * runs map instead of parsing the call files again.
+ *
+ *  header : char magic[8] = "DMMDSIG2", uint32 version, uint32 nChr,
+ *           uint32 bits, uint32 scale, uint64 reserved
+ *  table  : 2*nChr x SignalCacheEntry, the forward strand of chromosome i
+ *           at 2*i and the reverse one at 2*i+1
+ *  data   : per entry, n int32 coordinates in the order of CooMet (sorted
+ *           for sorted call files) and n methylation values, 8-byte
+ *           aligned. A value m is stored as the readers hold it, a
+ *           percentage p with m = p/100 (see signal_frequency): with 8 or
+ *           16 bits as round(p*scale), scale 2 and 100, with 32 bits as a
+ *           float. With 64 bits m is stored as a double.
+ *
+ * A file is written with the narrowest of the bits asked for and the wider
+ * ones from which every value reads back unchanged, so the cache never
+ * changes the signal: bedMethyl files fit in 32 bits, and in 8 or 16 bits
+ * when their percentages have up to 0 or 2 decimals; PB3Seq frequencies
+ * take 64 bits.
+ */
+
+#define SIGNAL_CACHE_MAGIC "DMMDSIG2"
+#define SIGNAL_CACHE_VERSION 2
+
+struct SignalCacheEntry {
+    uint64_t n;
+    uint64_t coo_offset;
+    uint64_t met_offset;
+};
+
+// Helper: scale of the percentages stored with bits bits.
+static inline uint32_t signal_cache_scale(uint32_t bits) {
+    return bits == 8 ? 2 : bits == 16 ? 100 : 0;
+}
+
+// Helper: the value stored for m with 8 or 16 bits, or -1 if m does not
+// read back unchanged from it.
+static long signal_cache_quantize(double m, uint32_t bits) {
+    uint32_t scale = signal_cache_scale(bits);
+    long max = bits == 8 ? 255 : 65535;
+    double q = nearbyint(m * 100.0 * scale);
+    if (!(q >= 0 && q <= max)) return -1;
+    if (signal_frequency((float) (q / scale)) != m) return -1;
+    return (long) q;
+}
+
+// Helper: true if every value of met reads back unchanged from bits bits.
+static bool signal_cache_fits(const vector<vector<double> >& met, uint32_t bits) {
+    for (size_t e = 0; e < met.size(); e++) {
+        for (size_t i = 0; i < met[e].size(); i++) {
+            double m = met[e][i];
+            if (bits == 32 && signal_frequency((float) (m * 100.0)) != m) return false;
+            if (bits < 32 && signal_cache_quantize(m, bits) < 0) return false;
+        }
+    }
+    return true;
+}
+
+// Helper: writes bytes, padding the file to a multiple of 8 bytes.
+static void signal_cache_write(FILE* pF, const void* data, size_t len, bool& ok) {
+    static const char zeros[8] = {0};
+    if (len > 0 && fwrite(data, 1, len, pF) != len) ok = false;
+    if (len % 8 && fwrite(zeros, 1, 8 - len % 8, pF) != 8 - len % 8) ok = false;
+}
+
+// [[Rcpp::export]]
+void WriteSignalCache_cpp(List CooMet, std::string Path, int Bits) {
+    // Writes the CooMet structure, list(CooMetFor, CooMetRev), to a signal
+    // cache file with at least Bits (8, 16 or 32) bits per methylation
+    // value, and more if some value would not read back unchanged.
+    List CooMetFor = CooMet[0], CooMetRev = CooMet[1];
+    uint32_t nChr = CooMetFor.size();
+    if ((uint32_t) CooMetRev.size() != nChr) {
+        stop("WriteSignalCache_cpp: forward and reverse lists differ in length");
+    }
+    if (Bits != 8 && Bits != 16 && Bits != 32) {
+        stop("WriteSignalCache_cpp: Bits must be 8, 16 or 32");
+    }
+
+    vector<vector<int> > coo(2 * nChr);
+    vector<vector<double> > met(2 * nChr);
+    for (uint32_t e = 0; e < 2 * nChr; e++) {
+        DataFrame df = e % 2 == 0 ? as<DataFrame>(CooMetFor[e / 2]) : as<DataFrame>(CooMetRev[e / 2]);
+        NumericVector ColCoo = df["ColCoo"], ColMet = df["ColMet"];
+        coo[e].assign(ColCoo.begin(), ColCoo.end());
+        met[e].assign(ColMet.begin(), ColMet.end());
+    }
+    uint32_t bits = Bits;
+    while (bits < 64 && !signal_cache_fits(met, bits)) bits *= 2;
+    uint32_t scale = signal_cache_scale(bits), version = SIGNAL_CACHE_VERSION;
+    size_t width = bits / 8;
+
+    vector<SignalCacheEntry> table(2 * nChr);
+    uint64_t off = 32 + (uint64_t) table.size() * sizeof(SignalCacheEntry);
+    for (uint32_t e = 0; e < 2 * nChr; e++) {
+        table[e].n = coo[e].size();
+        table[e].coo_offset = off;
+        off += (table[e].n * 4 + 7) / 8 * 8;
+        table[e].met_offset = off;
+        off += (table[e].n * width + 7) / 8 * 8;
+    }
+
+    FILE* pF = fopen(Path.c_str(), "wb");
+    if (pF == NULL) {
+        stop("WriteSignalCache_cpp: cannot create %s", Path);
+    }
+    bool ok = true;
+    uint64_t reserved = 0;
+    ok = fwrite(SIGNAL_CACHE_MAGIC, 1, 8, pF) == 8 && ok;
+    ok = fwrite(&version, 4, 1, pF) == 1 && ok;
+    ok = fwrite(&nChr, 4, 1, pF) == 1 && ok;
+    ok = fwrite(&bits, 4, 1, pF) == 1 && ok;
+    ok = fwrite(&scale, 4, 1, pF) == 1 && ok;
+    ok = fwrite(&reserved, 8, 1, pF) == 1 && ok;
+    signal_cache_write(pF, table.data(), table.size() * sizeof(SignalCacheEntry), ok);
+
+    for (uint32_t e = 0; e < 2 * nChr && ok; e++) {
+        signal_cache_write(pF, coo[e].data(), coo[e].size() * 4, ok);
+        size_t n = met[e].size();
+        if (bits == 8) {
+            vector<uint8_t> q(n);
+            for (size_t i = 0; i < n; i++) q[i] = (uint8_t) signal_cache_quantize(met[e][i], bits);
+            signal_cache_write(pF, q.data(), n, ok);
+        } else if (bits == 16) {
+            vector<uint16_t> q(n);
+            for (size_t i = 0; i < n; i++) q[i] = (uint16_t) signal_cache_quantize(met[e][i], bits);
+            signal_cache_write(pF, q.data(), 2 * n, ok);
+        } else if (bits == 32) {
+            vector<float> q(n);
+            for (size_t i = 0; i < n; i++) q[i] = (float) (met[e][i] * 100.0);
+            signal_cache_write(pF, q.data(), 4 * n, ok);
+        } else {
+            signal_cache_write(pF, met[e].data(), 8 * n, ok);
+        }
+    }
+    if (fclose(pF) != 0) ok = false;
+    if (!ok) {
+        remove(Path.c_str());
+        stop("WriteSignalCache_cpp: cannot write %s", Path);
+    }
+}
+
+// [[Rcpp::export]]
+List ReadSignalCache_cpp(std::string Path) {
+    // Maps a signal cache file and returns its CooMet structure, with integer
+    // coordinates and the methylation values as ReadCooMetFiles gave them.
+    int fd = open(Path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        stop("ReadSignalCache_cpp: cannot open %s", Path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 32) {
+        close(fd);
+        stop("ReadSignalCache_cpp: %s is not a signal cache file", Path);
+    }
+    size_t size = (size_t) st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        stop("ReadSignalCache_cpp: cannot map %s", Path);
+    }
+    const unsigned char* base = (const unsigned char*) map;
+
+    uint32_t version, nChr, bits, scale;
+    memcpy(&version, base + 8, 4);
+    memcpy(&nChr, base + 12, 4);
+    memcpy(&bits, base + 16, 4);
+    memcpy(&scale, base + 20, 4);
+    bool ok = memcmp(base, SIGNAL_CACHE_MAGIC, 8) == 0 && version == SIGNAL_CACHE_VERSION &&
+              (bits == 8 || bits == 16 || bits == 32 || bits == 64) && scale == signal_cache_scale(bits) &&
+              32 + (uint64_t) nChr * 2 * sizeof(SignalCacheEntry) <= size;
+    const SignalCacheEntry* table = (const SignalCacheEntry*) (base + 32);
+    for (uint32_t e = 0; ok && e < 2 * nChr; e++) {
+        ok = table[e].coo_offset % 8 == 0 && table[e].met_offset % 8 == 0 &&
+             table[e].n <= size && table[e].coo_offset + table[e].n * 4 <= size &&
+             table[e].met_offset + table[e].n * (bits / 8) <= size;
+    }
+    if (!ok) {
+        munmap(map, size);
+        stop("ReadSignalCache_cpp: %s is not a valid signal cache file", Path);
+    }
+
+    List CooMetFor(nChr), CooMetRev(nChr);
+    for (uint32_t e = 0; e < 2 * nChr; e++) {
+        R_xlen_t n = (R_xlen_t) table[e].n;
+        IntegerVector ColCoo(n);
+        NumericVector ColMet(n);
+        if (n > 0) memcpy(INTEGER(ColCoo), base + table[e].coo_offset, n * 4);
+        const unsigned char* m = base + table[e].met_offset;
+        double* out = REAL(ColMet);
+        if (bits == 8) {
+            for (R_xlen_t i = 0; i < n; i++) out[i] = signal_frequency((float) (m[i] / (double) scale));
+        } else if (bits == 16) {
+            const uint16_t* q = (const uint16_t*) m;
+            for (R_xlen_t i = 0; i < n; i++) out[i] = signal_frequency((float) (q[i] / (double) scale));
+        } else if (bits == 32) {
+            const float* q = (const float*) m;
+            for (R_xlen_t i = 0; i < n; i++) out[i] = signal_frequency(q[i]);
+        } else if (n > 0) {
+            memcpy(out, m, n * 8);
+        }
+        DataFrame df = DataFrame::create(Named("ColCoo") = ColCoo, Named("ColMet") = ColMet);
+        if (e % 2 == 0) CooMetFor[e / 2] = df; else CooMetRev[e / 2] = df;
+    }
+    munmap(map, size);
+    return List::create(CooMetFor, CooMetRev);
+}